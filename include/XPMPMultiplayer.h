@@ -268,9 +268,23 @@ typedef	void (* XPMPPlaneLoaded_f)(
  * a default.  The renderer uses them for configuration.  Currently the following keys are
  * needed:
  *
- * section	key					type	default	description
- * planes	full_distance		float	3.0
- * planes	max_full_count		int		50
+ * section	key							type	default	description
+ * planes	full_distance				float	3.0		miles within which planes are drawn as full models
+ * planes	max_full_count				int		100		most planes drawn as full models per view
+ * planes	max_shadow_count			int		50		most planes drawn into the shadow pass
+ * planes	impostors					int		0		1 draws planes beyond full_distance as impostors
+ * planes	max_label_count				int		100		most labels drawn after decluttering
+ * planes	frame_budget_ms				float	0.0		plane draw time per frame before detail drops; 0 disables
+ * planes	task_budget_ms				float	1.0		time per frame spent on deferred tasks
+ * planes	worker_threads				int		3		worker threads, capped to the cores less one
+ * planes	background_refresh_count	int		100		hibernating planes refreshed per frame
+ * planes	resolution					int		5		texture resolution, 5 is full size
+ * planes	texture_anisotropy			float	0.0		anisotropic filtering level; 0 disables
+ * debug	model_matching				int		0		1 logs how models are matched
+ * debug	tcas_traffic				int		1		1 shows the planes to X-Plane's TCAS
+ * debug	local_conversion			int		0		1 checks and logs the local conversion error
+ * debug	render_phases				int		0		1 logs the X-Plane draw phases
+ * debug	allow_obj8_async_load		int		0		1 loads OBJ8 models asynchronously
  *
  * The return value is a string indicating any problem that may have gone wrong in a human-readable
  * form, or an empty string if initalizatoin was okay.
@@ -299,9 +313,23 @@ const char *	XPMPMultiplayerInitLegacyData(
  * a default.  The renderer uses them for configuration.  Currently the following keys are
  * needed:
  *
- * section	key					type	default	description
- * planes	full_distance		float	3.0
- * planes	max_full_count		int		50
+ * section	key							type	default	description
+ * planes	full_distance				float	3.0		miles within which planes are drawn as full models
+ * planes	max_full_count				int		100		most planes drawn as full models per view
+ * planes	max_shadow_count			int		50		most planes drawn into the shadow pass
+ * planes	impostors					int		0		1 draws planes beyond full_distance as impostors
+ * planes	max_label_count				int		100		most labels drawn after decluttering
+ * planes	frame_budget_ms				float	0.0		plane draw time per frame before detail drops; 0 disables
+ * planes	task_budget_ms				float	1.0		time per frame spent on deferred tasks
+ * planes	worker_threads				int		3		worker threads, capped to the cores less one
+ * planes	background_refresh_count	int		100		hibernating planes refreshed per frame
+ * planes	resolution					int		5		texture resolution, 5 is full size
+ * planes	texture_anisotropy			float	0.0		anisotropic filtering level; 0 disables
+ * debug	model_matching				int		0		1 logs how models are matched
+ * debug	tcas_traffic				int		1		1 shows the planes to X-Plane's TCAS
+ * debug	local_conversion			int		0		1 checks and logs the local conversion error
+ * debug	render_phases				int		0		1 logs the X-Plane draw phases
+ * debug	allow_obj8_async_load		int		0		1 loads OBJ8 models asynchronously
  * 
  * Additionally takes a string path to the resource directory of the calling plugin for storing the
  * user vertical offset config file.
@@ -316,6 +344,15 @@ const char *    XPMPMultiplayerInit(
 		int (* inIntPrefsFunc)(const char *, const char *, int),
 		float (* inFloatPrefsFunc)(const char *, const char *, float));
 
+/*
+ * XPMPRefreshPrefs
+ *
+ * The library reads all prefs through the prefs funcs once at init and then about once a
+ * second.  Call this after changing a pref to have it take effect right away.
+ *
+ */
+void XPMPRefreshPrefs(void);
+
 /*
  * XPMPMultiplayerEnable
  *
@@ -453,6 +490,17 @@ int 	XPMPChangePlaneModel(
 		const char *			inAirline,
 		const char *			inLivery);
 
+/*
+ * XPMPSetPlaneLabelPriority
+ *
+ * Where labels would overlap on screen, only one of them is drawn: the one with the higher
+ * priority, or the closer plane if the priorities are the same.  Planes start out at 0.
+ *
+ */
+void	XPMPSetPlaneLabelPriority(
+		XPMPPlaneID				inPlaneID,
+		int						inPriority);
+
 /*
  * XPMPSetDefaultPlaneICAO
  *
@@ -24,15 +24,25 @@
 #ifndef XPLMPLANERENDERER_H
 #define XPLMPLANERENDERER_H
 
+#include "XPMPMultiplayer.h"
+
 // Theoretically you can plug in your own plane-rendering
 // function (although in practice this isn't real useful.
 // These functions do "the drawing" once per frame.
 
 void 			XPMPInitDefaultPlaneRenderer(void);
 void			XPMPDefaultPlaneRenderer(int is_blend);
+void			XPMPDefaultShadowRenderer(void);
 void			XPMPDefaultLabelRenderer();
 void			XPMPDeinitDefaultPlaneRenderer(void);
 
+// The default renderer works in two stages: this flight loop pulls all plane data from
+// the client and publishes it as one traffic frame, which the draw callbacks then only draw.
+float			XPMPDefaultPlaneRendererFlightLoop(float inElapsedSinceLastCall, float inElapsedTimeSinceLastFlightLoop, int inCounter, void * inRefcon);
+
+// Drops a plane that is about to be destroyed from the published traffic frames.
+void			XPMPDefaultPlaneRendererForgetPlane(XPMPPlaneID inPlane);
+
 double getCorrectYValue(double inX, double inY, double inZ, double inModelOffset, bool inIsClampingOn);
 
 #endif
@@ -25,6 +25,7 @@
 #include "XPLMUtilities.h"
 #include "XOGLUtils.h"
 #include "XPMPMultiplayerVars.h"
+#include "XPMPPrefs.h"
 #include <utility>
 #include <algorithm>
 #include <string>
@@ -280,7 +281,7 @@ bool LoadTextureFromMemory(ImageInfo &im, bool magentaAlpha, bool inWrap, bool m
 	{
 		XPLMDebugString(XPMP_CLIENT_NAME ": Something has errored the OpenGL stack prior to calling LoadTextureFromMemory, wtf?\n");
 	}
-	float	tex_anisotropyLevel = gFloatPrefsFunc("planes", "texture_anisotropy", 0.0);
+	float	tex_anisotropyLevel = gPrefs.textureAnisotropy;
 	if (sAnisotropicLevel == nullptr) {
 		sAnisotropicLevel = XPLMFindDataRef("sim/private/controls/reno/aniso_filter");
 	}
@@ -327,7 +328,8 @@ bool LoadTextureFromMemory(ImageInfo &im, bool magentaAlpha, bool inWrap, bool m
 	{
 		if (im.pad == 0)
 		{
-			XPLMBindTexture2d(texNum, 0);
+			// Through the state cache - uploads happen mid-draw, between cached binds.
+			OGL_BindTexture2d(texNum, 0);
 
 			
 			OGLDEBUG(glDebugMessageInsert(GL_DEBUG_SOURCE_THIRD_PARTY, GL_DEBUG_TYPE_MARKER, XPMP_DBG_TexLoad_CreateTex, GL_DEBUG_SEVERITY_NOTIFICATION, -1, "Creating Texture"));
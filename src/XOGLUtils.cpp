@@ -21,6 +21,8 @@
  *
  */
 #include "XOGLUtils.h"
+#include "XPLMGraphics.h"
+#include <algorithm>
 #include <set>
 #include <string>
 
@@ -34,6 +36,23 @@ PFNGLCLIENTACTIVETEXTUREARBPROC glClientActiveTextureARB = nullptr;
 PFNGLMULTITEXCOORD2FARBPROC		glMultiTexCoord2fARB	 = nullptr;
 PFNGLMULTITEXCOORD2FVARBPROC	glMultiTexCoord2fvARB	 = nullptr;
 PFNGLGENERATEMIPMAPPROC			glGenerateMipmap		 = nullptr;
+
+PFNGLGENFRAMEBUFFERSEXTPROC			glGenFramebuffersEXT		 = nullptr;
+PFNGLDELETEFRAMEBUFFERSEXTPROC		glDeleteFramebuffersEXT		 = nullptr;
+PFNGLBINDFRAMEBUFFEREXTPROC			glBindFramebufferEXT		 = nullptr;
+PFNGLFRAMEBUFFERTEXTURE2DEXTPROC	glFramebufferTexture2DEXT	 = nullptr;
+PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC	glCheckFramebufferStatusEXT	 = nullptr;
+PFNGLGENRENDERBUFFERSEXTPROC		glGenRenderbuffersEXT		 = nullptr;
+PFNGLDELETERENDERBUFFERSEXTPROC		glDeleteRenderbuffersEXT	 = nullptr;
+PFNGLBINDRENDERBUFFEREXTPROC		glBindRenderbufferEXT		 = nullptr;
+PFNGLRENDERBUFFERSTORAGEEXTPROC		glRenderbufferStorageEXT	 = nullptr;
+PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC	glFramebufferRenderbufferEXT = nullptr;
+
+PFNGLGENQUERIESPROC					glGenQueries				 = nullptr;
+PFNGLDELETEQUERIESPROC				glDeleteQueries				 = nullptr;
+PFNGLGETQUERYOBJECTIVPROC			glGetQueryObjectiv			 = nullptr;
+PFNGLQUERYCOUNTERPROC				glQueryCounter				 = nullptr;
+PFNGLGETQUERYOBJECTUI64VPROC		glGetQueryObjectui64v		 = nullptr;
 #endif
 
 #ifdef DEBUG
@@ -96,6 +115,25 @@ bool	OGL_UtilsInit()
 		glMultiTexCoord2fARB	 = (PFNGLMULTITEXCOORD2FARBPROC )	 wglGetProcAddress("glMultiTexCoord2fARB"    );
 		glMultiTexCoord2fvARB	 = (PFNGLMULTITEXCOORD2FVARBPROC )	 wglGetProcAddress("glMultiTexCoord2fvARB"   );
 		glGenerateMipmap		 = (PFNGLGENERATEMIPMAPPROC)		 wglGetProcAddress("glGenerateMipmap"		 );
+		if (OGL_HasExtension("GL_EXT_framebuffer_object")) {
+			glGenFramebuffersEXT		 = (PFNGLGENFRAMEBUFFERSEXTPROC)		 wglGetProcAddress("glGenFramebuffersEXT"		);
+			glDeleteFramebuffersEXT		 = (PFNGLDELETEFRAMEBUFFERSEXTPROC)		 wglGetProcAddress("glDeleteFramebuffersEXT"	);
+			glBindFramebufferEXT		 = (PFNGLBINDFRAMEBUFFEREXTPROC)		 wglGetProcAddress("glBindFramebufferEXT"		);
+			glFramebufferTexture2DEXT	 = (PFNGLFRAMEBUFFERTEXTURE2DEXTPROC)	 wglGetProcAddress("glFramebufferTexture2DEXT"	);
+			glCheckFramebufferStatusEXT	 = (PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC)	 wglGetProcAddress("glCheckFramebufferStatusEXT");
+			glGenRenderbuffersEXT		 = (PFNGLGENRENDERBUFFERSEXTPROC)		 wglGetProcAddress("glGenRenderbuffersEXT"		);
+			glDeleteRenderbuffersEXT	 = (PFNGLDELETERENDERBUFFERSEXTPROC)	 wglGetProcAddress("glDeleteRenderbuffersEXT"	);
+			glBindRenderbufferEXT		 = (PFNGLBINDRENDERBUFFEREXTPROC)		 wglGetProcAddress("glBindRenderbufferEXT"		);
+			glRenderbufferStorageEXT	 = (PFNGLRENDERBUFFERSTORAGEEXTPROC)	 wglGetProcAddress("glRenderbufferStorageEXT"	);
+			glFramebufferRenderbufferEXT = (PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC) wglGetProcAddress("glFramebufferRenderbufferEXT");
+		}
+		if (OGL_HasExtension("GL_ARB_timer_query")) {
+			glGenQueries				 = (PFNGLGENQUERIESPROC)				 wglGetProcAddress("glGenQueries"				);
+			glDeleteQueries				 = (PFNGLDELETEQUERIESPROC)				 wglGetProcAddress("glDeleteQueries"			);
+			glGetQueryObjectiv			 = (PFNGLGETQUERYOBJECTIVPROC)			 wglGetProcAddress("glGetQueryObjectiv"			);
+			glQueryCounter				 = (PFNGLQUERYCOUNTERPROC)				 wglGetProcAddress("glQueryCounter"				);
+			glGetQueryObjectui64v		 = (PFNGLGETQUERYOBJECTUI64VPROC)		 wglGetProcAddress("glGetQueryObjectui64v"		);
+		}
 #endif		
 #ifdef DEBUG_GL
 		if (OGL_HasExtension("GL_KHR_debug")) {
@@ -139,4 +177,104 @@ bool	OGL_UtilsInit()
 bool	OGL_HasExtension(const std::string &inExtensionName) 
 {
 	return (xpmp_glExtensions.count(inExtensionName) > 0);
-}
\ No newline at end of file
+}
+
+bool	OGL_HasFramebuffers()
+{
+#if IBM
+	if (!glGenFramebuffersEXT || !glBindFramebufferEXT || !glFramebufferTexture2DEXT || !glCheckFramebufferStatusEXT ||
+		!glGenRenderbuffersEXT || !glBindRenderbufferEXT || !glRenderbufferStorageEXT || !glFramebufferRenderbufferEXT)
+		return false;
+#endif
+	return OGL_HasExtension("GL_EXT_framebuffer_object");
+}
+
+bool	OGL_HasTimerQueries()
+{
+#if APL
+	return false;
+#else
+#if IBM
+	if (!glGenQueries || !glDeleteQueries || !glGetQueryObjectiv || !glQueryCounter || !glGetQueryObjectui64v)
+		return false;
+#endif
+	return OGL_HasExtension("GL_ARB_timer_query");
+#endif
+}
+
+/**************************************************
+			   State Cache
+***************************************************/
+
+static const int	kCachedUnits = 2;
+
+static bool		gStateKnown = false;
+static int		gState[7];
+static int		gBoundTexture[kCachedUnits] = { -1, -1 };	// -1 for unknown
+static GLint	gTexEnvMode[kCachedUnits] = { -1, -1 };		// -1 for unknown
+static int		gSavedStateChanges = 0;
+
+static void forget_texture_units()
+{
+	for (int n = 0; n < kCachedUnits; ++n)
+	{
+		gBoundTexture[n] = -1;
+		gTexEnvMode[n] = -1;
+	}
+}
+
+void	OGL_ResetStateCache()
+{
+	gStateKnown = false;
+	forget_texture_units();
+}
+
+void	OGL_SetGraphicsState(int fog, int numTex, int lighting, int alphaTest, int alphaBlend, int depthTest, int depthWrite)
+{
+	const int state[7] = { fog, numTex, lighting, alphaTest, alphaBlend, depthTest, depthWrite };
+	if (gStateKnown && std::equal(state, state + 7, gState))
+	{
+		++gSavedStateChanges;
+		return;
+	}
+	XPLMSetGraphicsState(fog, numTex, lighting, alphaTest, alphaBlend, depthTest, depthWrite);
+	std::copy(state, state + 7, gState);
+	gStateKnown = true;
+
+	// X-Plane doesn't promise to leave the texture environment alone when it turns units on and off.
+	for (int n = 0; n < kCachedUnits; ++n)
+		gTexEnvMode[n] = -1;
+}
+
+void	OGL_BindTexture2d(int texture, int unit)
+{
+	if (unit < kCachedUnits && gBoundTexture[unit] == texture)
+	{
+		++gSavedStateChanges;
+		return;
+	}
+	XPLMBindTexture2d(texture, unit);
+	if (unit < kCachedUnits)
+		gBoundTexture[unit] = texture;
+}
+
+void	OGL_SetTexEnvMode(int unit, GLint mode)
+{
+	if (unit < kCachedUnits && gTexEnvMode[unit] == mode)
+	{
+		++gSavedStateChanges;
+		return;
+	}
+	if (unit != 0) { glActiveTextureARB(GL_TEXTURE0 + unit); }
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+	if (unit != 0) { glActiveTextureARB(GL_TEXTURE0); }
+	if (unit < kCachedUnits)
+		gTexEnvMode[unit] = mode;
+}
+
+int		OGL_TakeSavedStateChanges()
+{
+	const int saved = gSavedStateChanges;
+	gSavedStateChanges = 0;
+	return saved;
+}
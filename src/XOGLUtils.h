@@ -69,6 +69,25 @@ extern PFNGLMULTITEXCOORD2FVARBPROC		glMultiTexCoord2fvARB;
 extern PFNGLACTIVETEXTUREARBPROC		glActiveTextureARB;
 extern PFNGLCLIENTACTIVETEXTUREARBPROC	glClientActiveTextureARB;
 extern PFNGLGENERATEMIPMAPPROC          glGenerateMipmap;
+
+// Framebuffer objects are optional - check OGL_HasFramebuffers before using them.
+extern PFNGLGENFRAMEBUFFERSEXTPROC			glGenFramebuffersEXT;
+extern PFNGLDELETEFRAMEBUFFERSEXTPROC		glDeleteFramebuffersEXT;
+extern PFNGLBINDFRAMEBUFFEREXTPROC			glBindFramebufferEXT;
+extern PFNGLFRAMEBUFFERTEXTURE2DEXTPROC		glFramebufferTexture2DEXT;
+extern PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC	glCheckFramebufferStatusEXT;
+extern PFNGLGENRENDERBUFFERSEXTPROC			glGenRenderbuffersEXT;
+extern PFNGLDELETERENDERBUFFERSEXTPROC		glDeleteRenderbuffersEXT;
+extern PFNGLBINDRENDERBUFFEREXTPROC			glBindRenderbufferEXT;
+extern PFNGLRENDERBUFFERSTORAGEEXTPROC		glRenderbufferStorageEXT;
+extern PFNGLFRAMEBUFFERRENDERBUFFEREXTPROC	glFramebufferRenderbufferEXT;
+
+// So are timer queries - check OGL_HasTimerQueries.
+extern PFNGLGENQUERIESPROC					glGenQueries;
+extern PFNGLDELETEQUERIESPROC				glDeleteQueries;
+extern PFNGLGETQUERYOBJECTIVPROC			glGetQueryObjectiv;
+extern PFNGLQUERYCOUNTERPROC				glQueryCounter;
+extern PFNGLGETQUERYOBJECTUI64VPROC			glGetQueryObjectui64v;
 #endif
 
 #ifdef DEBUG_GL
@@ -112,6 +131,31 @@ bool	OGL_UtilsInit();
 #include <string>
 bool	OGL_HasExtension(const std::string &inExtensionName);
 
+// True if we can render to textures with GL_EXT_framebuffer_object.
+bool	OGL_HasFramebuffers();
+
+// True if we can time GPU work with GL_ARB_timer_query.  Never on the Mac, where legacy contexts don't have it.
+bool	OGL_HasTimerQueries();
+
+/*
+ * OGL state cache
+ *
+ * Thin wrappers around XPLMSetGraphicsState, XPLMBindTexture2d and the texture environment that
+ * remember what they set last and skip the call when it wouldn't change anything.  Consecutive
+ * OBJ7 planes with the same livery then cost no state changes at all.
+ *
+ * The cache only knows about changes that went through it.  Call OGL_ResetStateCache before a run
+ * of cached calls and whenever X-Plane or other code may have changed the state in between.
+ *
+ */
+void	OGL_ResetStateCache();
+void	OGL_SetGraphicsState(int fog, int numTex, int lighting, int alphaTest, int alphaBlend, int depthTest, int depthWrite);
+void	OGL_BindTexture2d(int texture, int unit);
+void	OGL_SetTexEnvMode(int unit, GLint mode);		// Leaves texture unit 0 active
+
+// Returns how many calls the cache skipped since the last time we asked.
+int		OGL_TakeSavedStateChanges();
+
 #endif
 
 #endif
@@ -0,0 +1,97 @@
+#include "XPMPAllocations.h"
+
+#if DEBUG_ALLOCATIONS
+
+#include "XPLMUtilities.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static thread_local bool	tWatching = false;
+static std::size_t			gFrameAllocations = 0;		// Only the watching thread counts
+static bool					gFrameGrew = false;			// Somebody noted growth this frame
+
+// The containers that noted their capacity, with the most each ever had.  A fixed table, so
+// keeping track doesn't allocate itself.
+struct HighWater_t {
+	const void *	container;
+	std::size_t		capacity;
+};
+static const std::size_t	kMaxContainers = 64;
+static HighWater_t			gHighWater[kMaxContainers];
+static std::size_t			gContainerCount = 0;
+
+void * operator new(std::size_t size)
+{
+	if (tWatching) { ++gFrameAllocations; }
+	if (size == 0) { size = 1; }
+	for (;;)
+	{
+		if (void * block = std::malloc(size)) { return block; }
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) { throw std::bad_alloc(); }
+		handler();
+	}
+}
+
+void operator delete(void * block) noexcept
+{
+	std::free(block);
+}
+
+void operator delete(void * block, std::size_t) noexcept
+{
+	std::free(block);
+}
+
+void	ALLOC_BeginWatch()
+{
+	tWatching = true;
+}
+
+void	ALLOC_EndWatch()
+{
+	tWatching = false;
+}
+
+void	ALLOC_NoteCapacity(const void * container, std::size_t capacity)
+{
+	for (std::size_t n = 0; n < gContainerCount; ++n)
+	{
+		if (gHighWater[n].container != container) { continue; }
+		if (capacity > gHighWater[n].capacity)
+		{
+			gHighWater[n].capacity = capacity;
+			gFrameGrew = true;
+		}
+		return;
+	}
+
+	// One we haven't seen yet is just starting out.  If the table is full, we can't tell, so it
+	// always counts as growing.
+	if (gContainerCount < kMaxContainers)
+		gHighWater[gContainerCount++] = { container, capacity };
+	gFrameGrew = true;
+}
+
+void	ALLOC_NoteGrowth()
+{
+	gFrameGrew = true;
+}
+
+void	ALLOC_EndFrame(bool steady)
+{
+	if (steady && !gFrameGrew && gFrameAllocations > 0)
+	{
+		char buf[128];
+		snprintf(buf, sizeof(buf), "libxplanemp: %zu heap allocations in a steady state frame.\n", gFrameAllocations);
+		XPLMDebugString(buf);
+		assert(!"heap allocation in a steady state frame");
+	}
+	gFrameAllocations = 0;
+	gFrameGrew = false;
+}
+
+#endif
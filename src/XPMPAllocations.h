@@ -0,0 +1,77 @@
+#ifndef XPMPALLOCATIONS_H
+#define XPMPALLOCATIONS_H
+
+/*
+ * XPMPAllocations
+ *
+ * Drawing keeps all its scratch space from frame to frame, so once the traffic settles down a
+ * frame shouldn't touch the heap at all.  That matters beyond the allocation itself: the
+ * allocator's locks are shared with X-Plane's own threads, and waiting for them shows up as
+ * stutter.
+ *
+ * Build with DEBUG_ALLOCATIONS (the XPMP_DEBUG_ALLOCATIONS CMake option) to check.  We then
+ * replace the global operator new, count what the main thread allocates inside our draw
+ * callbacks, and assert that a steady state frame allocated nothing.  The flight loop isn't
+ * watched, since it calls into the client.  Without DEBUG_ALLOCATIONS, all of this is nothing.
+ *
+ * Even with the same traffic, scratch space still has to grow when it needs more room than it
+ * ever had - the camera turns toward more planes, a new label text comes up.  Code that keeps
+ * scratch space notes its capacity, and a frame where something grew is excused.
+ *
+ */
+
+#include <cstddef>
+
+#if DEBUG_ALLOCATIONS
+
+/*
+ * ALLOC_BeginWatch, ALLOC_EndWatch
+ *
+ * Bracket the work of one draw callback.  Don't nest them.
+ *
+ */
+void	ALLOC_BeginWatch();
+void	ALLOC_EndWatch();
+
+/*
+ * ALLOC_EndFrame
+ *
+ * Call once per frame.  steady says whether the traffic we drew in the last frame was the same
+ * as in the frames before.  Allocations are only reported if it was, and nothing noted growth.
+ *
+ */
+void	ALLOC_EndFrame(bool steady);
+
+/*
+ * ALLOC_NoteCapacity
+ *
+ * Call with a container that keeps its storage from frame to frame, after filling it.  If its
+ * capacity went past the most it ever had, this frame had a reason to allocate.  Anything with
+ * capacity() will do.
+ *
+ */
+void	ALLOC_NoteCapacity(const void * container, std::size_t capacity);
+
+template <typename Container>
+inline void	ALLOC_NoteCapacity(const Container & container) { ALLOC_NoteCapacity(&container, container.capacity()); }
+
+/*
+ * ALLOC_NoteGrowth
+ *
+ * For caches and the like, that just took a new entry: this frame had a reason to allocate.
+ *
+ */
+void	ALLOC_NoteGrowth();
+
+#else
+
+inline void	ALLOC_BeginWatch() {}
+inline void	ALLOC_EndWatch() {}
+inline void	ALLOC_EndFrame(bool) {}
+template <typename Container>
+inline void	ALLOC_NoteCapacity(const Container &) {}
+inline void	ALLOC_NoteGrowth() {}
+
+#endif
+
+#endif
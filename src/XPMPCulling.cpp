@@ -0,0 +1,221 @@
+#include "XPMPCulling.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define XPMP_CULL_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XPMP_CULL_SSE 1
+#endif
+
+void	CULL_SetupClipPlanes(cull_info_t * i)
+{
+	// Now...what the heck is this?  Here's the deal: the clip planes have values in "clip" coordinates of: Left = (1,0,0,1)
+	// Right = (-1,0,0,1), Bottom = (0,1,0,1), etc.  (Clip coordinates are coordinates from -1 to 1 in XYZ that the driver
+	// uses.  The projection matrix converts from eye to clip coordinates.)
+	//
+	// How do we convert a plane backward from clip to eye coordinates?  Well, we need the transpose of the inverse of the
+	// inverse of the projection matrix.  (Transpose of the inverse is needed to transform a plane, and the inverse of the
+	// projection is the matrix that goes clip -> eye.)  Well, that cancels out to the transpose of the projection matrix,
+	// which is nice because it means we don't need a matrix inversion in this bit of sample code.
+
+	// So this nightmare down here is simply:
+	// clip plane * transpose (proj_matrix)
+	// worked out for all six clip planes.  If you squint you can see the patterns:
+	// L:  1  0 0 1
+	// R: -1  0 0 1
+	// B:  0  1 0 1
+	// T:  0 -1 0 1
+	// etc.
+
+	i->lft_clip[0] = i->proj[0]+i->proj[3];	i->lft_clip[1] = i->proj[4]+i->proj[7];	i->lft_clip[2] = i->proj[8]+i->proj[11];	i->lft_clip[3] = i->proj[12]+i->proj[15];
+	i->rgt_clip[0] =-i->proj[0]+i->proj[3];	i->rgt_clip[1] =-i->proj[4]+i->proj[7];	i->rgt_clip[2] =-i->proj[8]+i->proj[11];	i->rgt_clip[3] =-i->proj[12]+i->proj[15];
+
+	i->bot_clip[0] = i->proj[1]+i->proj[3];	i->bot_clip[1] = i->proj[5]+i->proj[7];	i->bot_clip[2] = i->proj[9]+i->proj[11];	i->bot_clip[3] = i->proj[13]+i->proj[15];
+	i->top_clip[0] =-i->proj[1]+i->proj[3];	i->top_clip[1] =-i->proj[5]+i->proj[7];	i->top_clip[2] =-i->proj[9]+i->proj[11];	i->top_clip[3] =-i->proj[13]+i->proj[15];
+
+	i->nea_clip[0] = i->proj[2]+i->proj[3];	i->nea_clip[1] = i->proj[6]+i->proj[7];	i->nea_clip[2] = i->proj[10]+i->proj[11];	i->nea_clip[3] = i->proj[14]+i->proj[15];
+	i->far_clip[0] =-i->proj[2]+i->proj[3];	i->far_clip[1] =-i->proj[6]+i->proj[7];	i->far_clip[2] =-i->proj[10]+i->proj[11];	i->far_clip[3] =-i->proj[14]+i->proj[15];
+}
+
+// The six clip planes in the order we test them: near, bottom, top, left, right, far.  We normalize
+// them, so the plane equation gives a distance in meters and can be compared against the radius.
+static void gather_clip_planes(const cull_info_t * i, float planes[6][4])
+{
+	const float * src[6] = { i->nea_clip, i->bot_clip, i->top_clip, i->lft_clip, i->rgt_clip, i->far_clip };
+	for (int p = 0; p < 6; ++p)
+	{
+		const float len = std::sqrt(src[p][0]*src[p][0] + src[p][1]*src[p][1] + src[p][2]*src[p][2]);
+		const float scale = len > 0.0f ? 1.0f / len : 1.0f;
+		for (int c = 0; c < 4; ++c)
+			planes[p][c] = src[p][c] * scale;
+	}
+}
+
+// The reference implementation - one sphere at a time.  Used when we have no SIMD and for the tail.
+static inline bool cull_one(const float * mv, const float planes[6][4], float x, float y, float z, float r, float * outDist, float * outMargin)
+{
+	// First: we transform our coordinate into eye coordinates from model-view.
+	const float xp = x * mv[0] + y * mv[4] + z * mv[ 8] + mv[12];
+	const float yp = x * mv[1] + y * mv[5] + z * mv[ 9] + mv[13];
+	const float zp = x * mv[2] + y * mv[6] + z * mv[10] + mv[14];
+
+	*outDist = std::sqrt(xp*xp + yp*yp + zp*zp);
+
+	// Now - we apply the "plane equation" of each clip plane to see how far from the clip plane our point is.
+	// The clip planes are directed: positive number distances mean we are INSIDE our viewing area by some distance;
+	// negative means outside.  So ... if we are outside by less than -r, the ENTIRE sphere is out of bounds.
+	bool inside = true;
+	float nearest = FLT_MAX;
+	for (int p = 0; p < 6; ++p)
+	{
+		const float d = xp * planes[p][0] + yp * planes[p][1] + zp * planes[p][2] + planes[p][3] + r;
+		if (d < 0)
+			inside = false;
+		nearest = std::min(nearest, d);
+	}
+	*outMargin = nearest;
+	return inside;
+}
+
+#if XPMP_CULL_AVX
+
+static inline unsigned cull_eight(const __m256 * mv, const __m256 (* planes)[4],
+								  const float * x, const float * y, const float * z, const float * r, float * outDist, float * outMargin)
+{
+	const __m256 vx = _mm256_loadu_ps(x);
+	const __m256 vy = _mm256_loadu_ps(y);
+	const __m256 vz = _mm256_loadu_ps(z);
+	const __m256 vr = _mm256_loadu_ps(r);
+
+	const __m256 xp = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, mv[0]), _mm256_mul_ps(vy, mv[4])), _mm256_add_ps(_mm256_mul_ps(vz, mv[ 8]), mv[12]));
+	const __m256 yp = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, mv[1]), _mm256_mul_ps(vy, mv[5])), _mm256_add_ps(_mm256_mul_ps(vz, mv[ 9]), mv[13]));
+	const __m256 zp = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, mv[2]), _mm256_mul_ps(vy, mv[6])), _mm256_add_ps(_mm256_mul_ps(vz, mv[10]), mv[14]));
+
+	_mm256_storeu_ps(outDist, _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(xp, xp), _mm256_mul_ps(yp, yp)), _mm256_mul_ps(zp, zp))));
+
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+	__m256 nearest = _mm256_set1_ps(FLT_MAX);
+	for (int p = 0; p < 6; ++p)
+	{
+		const __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(xp, planes[p][0]), _mm256_mul_ps(yp, planes[p][1])),
+									   _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(zp, planes[p][2]), planes[p][3]), vr));
+		inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+		nearest = _mm256_min_ps(nearest, d);
+	}
+	_mm256_storeu_ps(outMargin, nearest);
+	return static_cast<unsigned>(_mm256_movemask_ps(inside));
+}
+
+#elif XPMP_CULL_SSE
+
+static inline unsigned cull_four(const __m128 * mv, const __m128 (* planes)[4],
+								 const float * x, const float * y, const float * z, const float * r, float * outDist, float * outMargin)
+{
+	const __m128 vx = _mm_loadu_ps(x);
+	const __m128 vy = _mm_loadu_ps(y);
+	const __m128 vz = _mm_loadu_ps(z);
+	const __m128 vr = _mm_loadu_ps(r);
+
+	const __m128 xp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, mv[0]), _mm_mul_ps(vy, mv[4])), _mm_add_ps(_mm_mul_ps(vz, mv[ 8]), mv[12]));
+	const __m128 yp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, mv[1]), _mm_mul_ps(vy, mv[5])), _mm_add_ps(_mm_mul_ps(vz, mv[ 9]), mv[13]));
+	const __m128 zp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, mv[2]), _mm_mul_ps(vy, mv[6])), _mm_add_ps(_mm_mul_ps(vz, mv[10]), mv[14]));
+
+	_mm_storeu_ps(outDist, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(xp, xp), _mm_mul_ps(yp, yp)), _mm_mul_ps(zp, zp))));
+
+	const __m128 zero = _mm_setzero_ps();
+	__m128 inside = _mm_cmpeq_ps(zero, zero);
+	__m128 nearest = _mm_set1_ps(FLT_MAX);
+	for (int p = 0; p < 6; ++p)
+	{
+		const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xp, planes[p][0]), _mm_mul_ps(yp, planes[p][1])),
+									_mm_add_ps(_mm_add_ps(_mm_mul_ps(zp, planes[p][2]), planes[p][3]), vr));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+		nearest = _mm_min_ps(nearest, d);
+	}
+	_mm_storeu_ps(outMargin, nearest);
+	return static_cast<unsigned>(_mm_movemask_ps(inside));
+}
+
+#endif
+
+void	CULL_Spheres(const cull_info_t * i, const CullSpheres_t & spheres, CullResults_t & results)
+{
+	const std::size_t n = spheres.size();
+	results.visible.assign((n + 7) / 8, 0);
+	results.distance.resize(n);
+	results.margin.resize(n);
+
+	float planes[6][4];
+	gather_clip_planes(i, planes);
+
+	const float * x = spheres.x.data();
+	const float * y = spheres.y.data();
+	const float * z = spheres.z.data();
+	const float * r = spheres.r.data();
+	float * dist = results.distance.data();
+	float * margin = results.margin.data();
+	uint8_t * visible = results.visible.data();
+
+	std::size_t k = 0;
+
+#if XPMP_CULL_AVX
+	__m256 mv[16];
+	__m256 vplanes[6][4];
+	for (int m = 0; m < 16; ++m) mv[m] = _mm256_set1_ps(i->model_view[m]);
+	for (int p = 0; p < 6; ++p)
+		for (int c = 0; c < 4; ++c)
+			vplanes[p][c] = _mm256_set1_ps(planes[p][c]);
+
+	for (; k + 8 <= n; k += 8)
+		visible[k >> 3] = static_cast<uint8_t>(cull_eight(mv, vplanes, x + k, y + k, z + k, r + k, dist + k, margin + k));
+#elif XPMP_CULL_SSE
+	__m128 mv[16];
+	__m128 vplanes[6][4];
+	for (int m = 0; m < 16; ++m) mv[m] = _mm_set1_ps(i->model_view[m]);
+	for (int p = 0; p < 6; ++p)
+		for (int c = 0; c < 4; ++c)
+			vplanes[p][c] = _mm_set1_ps(planes[p][c]);
+
+	for (; k + 8 <= n; k += 8)
+	{
+		const unsigned lo = cull_four(mv, vplanes, x + k,     y + k,     z + k,     r + k,     dist + k,     margin + k);
+		const unsigned hi = cull_four(mv, vplanes, x + k + 4, y + k + 4, z + k + 4, r + k + 4, dist + k + 4, margin + k + 4);
+		visible[k >> 3] = static_cast<uint8_t>(lo | (hi << 4));
+	}
+#endif
+
+	for (; k < n; ++k)
+	{
+		if (cull_one(i->model_view, planes, x[k], y[k], z[k], r[k], dist + k, margin + k))
+			visible[k >> 3] |= static_cast<uint8_t>(1u << (k & 7));
+	}
+}
+
+void	CULL_EyePosition(const cull_info_t * i, float outEye[3])
+{
+	// The model view matrix is a rotation R and a translation t, so the eye sits at -R^T t.
+	const float * mv = i->model_view;
+	outEye[0] = -(mv[0] * mv[12] + mv[1] * mv[13] + mv[ 2] * mv[14]);
+	outEye[1] = -(mv[4] * mv[12] + mv[5] * mv[13] + mv[ 6] * mv[14]);
+	outEye[2] = -(mv[8] * mv[12] + mv[9] * mv[13] + mv[10] * mv[14]);
+}
+
+float	CULL_ViewTurn(const cull_info_t * from, const cull_info_t * to)
+{
+	// The angle of the rotation between the two views is acos((trace(R1 R0^T) - 1) / 2),
+	// and the trace of R1 R0^T is just the sum of the products of the matching elements.
+	const float * a = from->model_view;
+	const float * b = to->model_view;
+	float trace = 0.0f;
+	for (int c = 0; c < 3; ++c)
+		for (int r = 0; r < 3; ++r)
+			trace += a[c * 4 + r] * b[c * 4 + r];
+	const float cosAngle = std::max(-1.0f, std::min(1.0f, (trace - 1.0f) * 0.5f));
+	return std::acos(cosAngle);
+}
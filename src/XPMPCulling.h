@@ -0,0 +1,86 @@
+#ifndef XPMPCULLING_H
+#define XPMPCULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * XPMPCulling
+ *
+ * Batch frustum culling.  Once per frame the renderer takes a snapshot of the bounding
+ * spheres of all candidate planes as a structure of arrays, and CULL_Spheres runs the
+ * frustum test over all of them at once - eight spheres per iteration with AVX or two
+ * SSE registers, with a scalar loop for everything else and for the tail.
+ *
+ */
+
+struct cull_info_t {					// This struct has everything we need to cull fast!
+	float	model_view[16];				// The model view matrix, to get from local OpenGL to eye coordinates.
+	float	proj[16];					// Proj matrix - this is just a hack to use for gluProject.
+	float	nea_clip[4];				// Four clip planes in the form of Ax + By + Cz + D = 0 (ABCD are in the array.)
+	float	far_clip[4];				// They are oriented so the positive side of the clip plane is INSIDE the view volume.
+	float	lft_clip[4];
+	float	rgt_clip[4];
+	float	bot_clip[4];
+	float	top_clip[4];
+};
+
+/*
+ * CULL_SetupClipPlanes
+ *
+ * Given the model view and projection matrices in a cull_info_t, this routine derives the
+ * six clip planes.
+ *
+ */
+void	CULL_SetupClipPlanes(cull_info_t * i);
+
+// One frame's bounding spheres, in local OpenGL coordinates.
+struct CullSpheres_t {
+	std::vector<float>	x;
+	std::vector<float>	y;
+	std::vector<float>	z;
+	std::vector<float>	r;
+
+	void clear() { x.clear(); y.clear(); z.clear(); r.clear(); }
+	void push(float inX, float inY, float inZ, float inR) { x.push_back(inX); y.push_back(inY); z.push_back(inZ); r.push_back(inR); }
+	std::size_t size() const { return x.size(); }
+	std::size_t capacity() const { return x.capacity() + y.capacity() + z.capacity() + r.capacity(); }
+};
+
+// Results of one CULL_Spheres run.  Bit n%8 of visible[n/8] is set if sphere n is in the frustum.
+struct CullResults_t {
+	std::vector<uint8_t>	visible;
+	std::vector<float>		distance;	// distance from the camera in meters
+	std::vector<float>		margin;		// how far inside (positive) or outside (negative) the frustum, in meters
+
+	bool isVisible(std::size_t n) const { return (visible[n >> 3] >> (n & 7)) & 1; }
+	std::size_t capacity() const { return visible.capacity() + distance.capacity() + margin.capacity(); }
+};
+
+/*
+ * CULL_Spheres
+ *
+ * Runs the frustum test for all spheres and computes their distance from the camera.
+ * Results are resized as needed, but keep their storage between calls.
+ *
+ */
+void	CULL_Spheres(const cull_info_t * i, const CullSpheres_t & spheres, CullResults_t & results);
+
+/*
+ * CULL_EyePosition
+ *
+ * Where the camera is, in the same local OpenGL coordinates as the spheres.
+ *
+ */
+void	CULL_EyePosition(const cull_info_t * i, float outEye[3]);
+
+/*
+ * CULL_ViewTurn
+ *
+ * By how much the camera turned between two views, in radians.
+ *
+ */
+float	CULL_ViewTurn(const cull_info_t * from, const cull_info_t * to);
+
+#endif
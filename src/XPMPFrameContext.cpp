@@ -0,0 +1,121 @@
+#include "XPMPFrameContext.h"
+#include "XOGLUtils.h"
+
+#include "XPLMDataAccess.h"
+#include "XPLMProcessing.h"
+#include "XPLMUtilities.h"
+
+// Lit textures go on when more of the scenery lights are on than this.
+static const float	kNightLightsOn = 0.25f;
+
+static FrameContext_t	gContext;
+
+static bool				gRefsInitialised = false;
+static XPLMDataRef		gModelviewMatrixRef = nullptr;
+static XPLMDataRef		gProjectionMatrixRef = nullptr;
+static XPLMDataRef		gViewportRef = nullptr;
+static XPLMDataRef		gVisibilityRef = nullptr;
+static XPLMDataRef		gLightsOnRef = nullptr;
+static XPLMDataRef		gFOVRef = nullptr;
+static XPLMDataRef		gHDROnRef = nullptr;
+static XPLMDataRef		gSSAAXRatioRef = nullptr;
+static XPLMDataRef		gSSAAYRatioRef = nullptr;
+static XPLMDataRef		gOwnPlaneX = nullptr;
+static XPLMDataRef		gOwnPlaneY = nullptr;
+static XPLMDataRef		gOwnPlaneZ = nullptr;
+static XPLMDataRef		gOwnPlaneLat = nullptr;
+static XPLMDataRef		gOwnPlaneLon = nullptr;
+static XPLMDataRef		gOwnPlaneElevation = nullptr;
+
+static void init_refs()
+{
+	gModelviewMatrixRef = XPLMFindDataRef("sim/graphics/view/modelview_matrix");
+	gProjectionMatrixRef = XPLMFindDataRef("sim/graphics/view/projection_matrix");
+	gViewportRef = XPLMFindDataRef("sim/graphics/view/viewport");
+
+	gVisibilityRef = XPLMFindDataRef("sim/graphics/view/visibility_effective_m");
+	if (!gVisibilityRef) gVisibilityRef = XPLMFindDataRef("sim/weather/visibility_effective_m");
+	if (!gVisibilityRef)
+		XPLMDebugString("WARNING: Default renderer could not find effective visibility in the sim.\n");
+
+	gLightsOnRef = XPLMFindDataRef("sim/graphics/scenery/percent_lights_on");
+	gFOVRef = XPLMFindDataRef("sim/graphics/view/field_of_view_deg");
+	gHDROnRef = XPLMFindDataRef("sim/graphics/settings/HDR_on");
+	gSSAAXRatioRef = XPLMFindDataRef("sim/private/controls/hdr/fsaa_ratio_x");
+	gSSAAYRatioRef = XPLMFindDataRef("sim/private/controls/hdr/fsaa_ratio_y");
+
+	gOwnPlaneX = XPLMFindDataRef("sim/flightmodel/position/local_x");
+	gOwnPlaneY = XPLMFindDataRef("sim/flightmodel/position/local_y");
+	gOwnPlaneZ = XPLMFindDataRef("sim/flightmodel/position/local_z");
+	gOwnPlaneLat = XPLMFindDataRef("sim/flightmodel/position/latitude");
+	gOwnPlaneLon = XPLMFindDataRef("sim/flightmodel/position/longitude");
+	gOwnPlaneElevation = XPLMFindDataRef("sim/flightmodel/position/elevation");
+
+	gRefsInitialised = true;
+}
+
+const FrameContext_t &	FRAME_Begin()
+{
+	const int cycle = XPLMGetCycleNumber();
+	if (cycle == gContext.cycle) { return gContext; }
+	if (!gRefsInitialised) { init_refs(); }
+
+	gContext.cycle = cycle;
+	gContext.elapsed = XPLMGetElapsedTime();
+	gContext.visibility = gVisibilityRef ? XPLMGetDataf(gVisibilityRef) : 0.0;
+	gContext.lightsOn = gLightsOnRef ? XPLMGetDataf(gLightsOnRef) : 0.0f;
+	gContext.night = gContext.lightsOn > kNightLightsOn;
+	if (gFOVRef) { gContext.fov = XPLMGetDataf(gFOVRef); }
+
+	// The SSAA hack only applies with HDR on.
+	gContext.ssaaX = gContext.ssaaY = 1.0f;
+	if (gHDROnRef && XPLMGetDatai(gHDROnRef))
+	{
+		if (gSSAAXRatioRef) { gContext.ssaaX = XPLMGetDataf(gSSAAXRatioRef); }
+		if (gSSAAYRatioRef) { gContext.ssaaY = XPLMGetDataf(gSSAAYRatioRef); }
+	}
+
+	gContext.ownX = XPLMGetDatad(gOwnPlaneX);
+	gContext.ownY = XPLMGetDatad(gOwnPlaneY);
+	gContext.ownZ = XPLMGetDatad(gOwnPlaneZ);
+	gContext.ownLat = XPLMGetDatad(gOwnPlaneLat);
+	gContext.ownLon = XPLMGetDatad(gOwnPlaneLon);
+	gContext.ownElevation = XPLMGetDatad(gOwnPlaneElevation);
+
+	XPLMReadCameraPosition(&gContext.camera);
+	return gContext;
+}
+
+const FrameContext_t &	FRAME_BeginView()
+{
+	FRAME_Begin();
+	XPLMReadCameraPosition(&gContext.camera);
+
+	// If our X-Plane version supports it, pull the matrices from the datarefs to avoid a
+	// potential driver stall.
+	cull_info_t &view = gContext.view;
+	if (!gModelviewMatrixRef || !gProjectionMatrixRef) {
+		glGetFloatv(GL_MODELVIEW_MATRIX, view.model_view);
+		glGetFloatv(GL_PROJECTION_MATRIX, view.proj);
+	} else {
+		XPLMGetDatavf(gModelviewMatrixRef, view.model_view, 0, 16);
+		XPLMGetDatavf(gProjectionMatrixRef, view.proj, 0, 16);
+	}
+	CULL_SetupClipPlanes(&view);
+
+	int * vp = gContext.viewport;
+	if (gViewportRef != nullptr) {
+		// sim/graphics/view/viewport	int[4]	n	Pixels	Current OpenGL viewport in device window coordinates.Note thiat this is left, bottom, right top, NOT left, bottom, width, height!!
+		int vpInt[4] = {0,0,0,0};
+		XPLMGetDatavi(gViewportRef, vpInt, 0, 4);
+		vp[0] = vpInt[0];
+		vp[1] = vpInt[1];
+		vp[2] = vpInt[2] - vpInt[0];
+		vp[3] = vpInt[3] - vpInt[1];
+	} else {
+		GLint glVp[4];
+		glGetIntegerv(GL_VIEWPORT, glVp);
+		for (int n = 0; n < 4; ++n) { vp[n] = glVp[n]; }
+	}
+	return gContext;
+}
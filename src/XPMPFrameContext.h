@@ -0,0 +1,61 @@
+#ifndef XPMPFRAMECONTEXT_H
+#define XPMPFRAMECONTEXT_H
+
+#include "XPMPCulling.h"
+
+#include "XPLMCamera.h"
+
+/*
+ * XPMPFrameContext
+ *
+ * Everything we need to know about the sim to move and draw planes, read once per frame - our
+ * own plane, visibility, lighting, the time - instead of once per plane or per pass.  The
+ * flight loop and all drawing code get it passed in.
+ *
+ * The view is the exception: X-Plane calls the draw callbacks with a different camera for
+ * shadow maps, reflections and each VR eye, so every callback reads that part again.
+ *
+ */
+
+struct FrameContext_t {
+	int						cycle = -1;				// XPLMGetCycleNumber this was read in
+	float					elapsed = 0.0f;			// XPLMGetElapsedTime, for blinking lights
+	double					visibility = 0.0;		// Effective visibility in meters
+	float					lightsOn = 0.0f;		// Share of the scenery lights that are on
+	bool					night = false;			// Enough of them to switch to lit textures
+	float					fov = 60.0f;			// Field of view in degrees
+	float					ssaaX = 1.0f;			// Supersampling ratios in HDR mode, 1 otherwise
+	float					ssaaY = 1.0f;
+
+	double					ownX = 0.0;				// Our own plane, in local OpenGL coordinates
+	double					ownY = 0.0;
+	double					ownZ = 0.0;
+	double					ownLat = 0.0;
+	double					ownLon = 0.0;
+	double					ownElevation = 0.0;		// Meters above MSL
+
+	// The view of the current draw callback.  The camera is also good in the flight loop, the rest isn't.
+	XPLMCameraPosition_t	camera;
+	cull_info_t				view;					// Matrices and clip planes
+	int						viewport[4];			// Left, bottom, width, height
+};
+
+/*
+ * FRAME_Begin
+ *
+ * Returns the context of the current frame.  The first call in a frame reads the sim state,
+ * later ones just return it.
+ *
+ */
+const FrameContext_t &	FRAME_Begin();
+
+/*
+ * FRAME_BeginView
+ *
+ * Same, but also reads the current camera, matrices and viewport.  Call at the start of every
+ * draw callback.
+ *
+ */
+const FrameContext_t &	FRAME_BeginView();
+
+#endif
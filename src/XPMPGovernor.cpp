@@ -0,0 +1,201 @@
+#include "XPMPGovernor.h"
+#include "XPMPPrefs.h"
+#include "XOGLUtils.h"
+
+#include "XPLMProcessing.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// The detail level never goes below this - some traffic always gets drawn properly.
+static const float	kMinDetail = 0.1f;
+
+// Down quickly, up slowly.
+static const float	kStepDown = 0.1f;
+static const float	kStepUp = 0.05f;
+static const int	kStepDownFrames = 15;		// Over budget for this many frames in a row - about as long as the averages take to follow a step
+static const int	kStepUpFrames = 60;			// Under kStepUpFraction of it for this many
+static const float	kStepUpFraction = 0.75f;
+
+// How quickly the averages follow new measurements.
+static const float	kSmoothing = 0.1f;
+
+// At most this many draw callbacks can be waiting for their GPU timings.
+static const std::size_t	kMaxPendingQueries = 16;
+
+typedef std::chrono::steady_clock	Clock;
+
+struct GpuTiming_t {
+	int		cycle;
+	GLuint	begin;
+	GLuint	end;
+};
+
+static float				gDetail = 1.0f;
+static int					gOverFrames = 0;
+static int					gUnderFrames = 0;
+
+static Clock::time_point	gCpuStart;
+static double				gCpuFrameMs = 0.0;		// This frame so far
+static float				gCpuMs = 0.0f;			// Smoothed
+static float				gGpuMs = 0.0f;			// Smoothed, 0 if we can't tell
+
+static bool					gGpuEnabled = false;
+static std::vector<GLuint>	gFreeQueries;
+static GpuTiming_t			gPendingQueries[kMaxPendingQueries];	// Oldest first, from gPendingFirst on - a ring, so waiting never allocates
+static std::size_t			gPendingFirst = 0;
+static std::size_t			gPendingCount = 0;
+static GpuTiming_t			gCurrentQuery;
+static bool					gQueryOpen = false;
+static int					gCollectCycle = -1;		// The frame we are summing GPU times for
+static double				gCollectMs = 0.0;
+
+static float budget_ms()
+{
+	return gPrefs.frameBudgetMs;
+}
+
+void	GOV_BeginCpu()
+{
+	gCpuStart = Clock::now();
+}
+
+void	GOV_EndCpu()
+{
+	gCpuFrameMs += std::chrono::duration<double, std::milli>(Clock::now() - gCpuStart).count();
+}
+
+// Picks up whatever GPU timings have come in, in order, and smooths each complete frame into gGpuMs.
+static void collect_gpu_timings()
+{
+#if !APL
+	while (gPendingCount > 0)
+	{
+		const GpuTiming_t &timing = gPendingQueries[gPendingFirst];
+		GLint available = 0;
+		glGetQueryObjectiv(timing.end, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) { return; }
+
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(timing.begin, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(timing.end, GL_QUERY_RESULT, &end);
+
+		if (timing.cycle != gCollectCycle)
+		{
+			if (gCollectCycle >= 0)
+				gGpuMs += kSmoothing * (static_cast<float>(gCollectMs) - gGpuMs);
+			gCollectCycle = timing.cycle;
+			gCollectMs = 0.0;
+		}
+		gCollectMs += static_cast<double>(end - begin) * 1.0e-6;
+
+		gFreeQueries.push_back(timing.begin);
+		gFreeQueries.push_back(timing.end);
+		gPendingFirst = (gPendingFirst + 1) % kMaxPendingQueries;
+		--gPendingCount;
+	}
+#endif
+}
+
+void	GOV_BeginGpu()
+{
+#if !APL
+	if (!gGpuEnabled)
+	{
+		if (budget_ms() <= 0.0f || !OGL_HasTimerQueries()) { return; }
+		gGpuEnabled = true;
+		gFreeQueries.resize(2 * kMaxPendingQueries);
+		glGenQueries(static_cast<GLsizei>(gFreeQueries.size()), gFreeQueries.data());
+	}
+	collect_gpu_timings();
+	if (gFreeQueries.size() < 2) { return; }		// The GPU is way behind - skip this one.
+
+	gCurrentQuery.cycle = XPLMGetCycleNumber();
+	gCurrentQuery.begin = gFreeQueries.back();
+	gFreeQueries.pop_back();
+	gCurrentQuery.end = gFreeQueries.back();
+	gFreeQueries.pop_back();
+	glQueryCounter(gCurrentQuery.begin, GL_TIMESTAMP);
+	gQueryOpen = true;
+#endif
+}
+
+void	GOV_EndGpu()
+{
+#if !APL
+	if (!gQueryOpen) { return; }
+	glQueryCounter(gCurrentQuery.end, GL_TIMESTAMP);
+	gPendingQueries[(gPendingFirst + gPendingCount++) % kMaxPendingQueries] = gCurrentQuery;
+	gQueryOpen = false;
+#endif
+}
+
+void	GOV_EndFrame()
+{
+	gCpuMs += kSmoothing * (static_cast<float>(gCpuFrameMs) - gCpuMs);
+	gCpuFrameMs = 0.0;
+
+	const float budget = budget_ms();
+	if (budget <= 0.0f)
+	{
+		gDetail = 1.0f;
+		gOverFrames = gUnderFrames = 0;
+		return;
+	}
+
+	const float spent = std::max(gCpuMs, gGpuMs);
+	if (spent > budget)
+	{
+		gUnderFrames = 0;
+		if (++gOverFrames >= kStepDownFrames)
+		{
+			gDetail = std::max(gDetail - kStepDown, kMinDetail);
+			gOverFrames = 0;
+		}
+	}
+	else if (spent < budget * kStepUpFraction)
+	{
+		gOverFrames = 0;
+		if (++gUnderFrames >= kStepUpFrames)
+		{
+			gDetail = std::min(gDetail + kStepUp, 1.0f);
+			gUnderFrames = 0;
+		}
+	}
+	else
+	{
+		gOverFrames = gUnderFrames = 0;
+	}
+}
+
+float	GOV_Detail()
+{
+	return gDetail;
+}
+
+void	GOV_Cleanup()
+{
+#if !APL
+	for (std::size_t n = 0; n < gPendingCount; ++n)
+	{
+		const GpuTiming_t &timing = gPendingQueries[(gPendingFirst + n) % kMaxPendingQueries];
+		gFreeQueries.push_back(timing.begin);
+		gFreeQueries.push_back(timing.end);
+	}
+	if (gQueryOpen)
+	{
+		gFreeQueries.push_back(gCurrentQuery.begin);
+		gFreeQueries.push_back(gCurrentQuery.end);
+	}
+	if (!gFreeQueries.empty())
+		glDeleteQueries(static_cast<GLsizei>(gFreeQueries.size()), gFreeQueries.data());
+#endif
+	gFreeQueries.clear();
+	gPendingFirst = gPendingCount = 0;
+	gQueryOpen = false;
+	gGpuEnabled = false;
+	gDetail = 1.0f;
+	gCpuMs = gGpuMs = 0.0f;
+	gCollectCycle = -1;
+}
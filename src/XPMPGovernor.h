@@ -0,0 +1,64 @@
+#ifndef XPMPGOVERNOR_H
+#define XPMPGOVERNOR_H
+
+/*
+ * XPMPGovernor
+ *
+ * An optional frame time governor.  When the planes:frame_budget_ms pref is set, it measures how
+ * long the library takes every frame - CPU time in the flight loop and draw callbacks, and GPU
+ * time of the draw callbacks where timer queries exist - and picks a detail level between 0 and 1
+ * so the larger of the two stays within the budget.  The renderer scales the number of full
+ * planes, the full detail distance, shadow casters and labels by it, and drops the lights of
+ * dot sized planes when it gets low.
+ *
+ * The level steps down as soon as we have been over budget for a few frames, but only steps back
+ * up after we have been well under it for a second or so, and by a smaller step - so it settles
+ * instead of oscillating.  Without the pref, the level is always 1.
+ *
+ */
+
+/*
+ * GOV_BeginCpu, GOV_EndCpu
+ *
+ * Bracket work on the main thread that counts against the budget.  Don't nest them.
+ *
+ */
+void	GOV_BeginCpu();
+void	GOV_EndCpu();
+
+/*
+ * GOV_BeginGpu, GOV_EndGpu
+ *
+ * Bracket the GL commands of one draw callback.  Call from inside the callback.  The results come
+ * in a few frames later; we never wait for them.
+ *
+ */
+void	GOV_BeginGpu();
+void	GOV_EndGpu();
+
+/*
+ * GOV_EndFrame
+ *
+ * Call once per frame, from the flight loop.  Collects the last frame's timings and moves the
+ * detail level.
+ *
+ */
+void	GOV_EndFrame();
+
+/*
+ * GOV_Detail
+ *
+ * The current detail level, 1 for full detail.
+ *
+ */
+float	GOV_Detail();
+
+/*
+ * GOV_Cleanup
+ *
+ * Releases the timer queries.  Call with a GL context.
+ *
+ */
+void	GOV_Cleanup();
+
+#endif
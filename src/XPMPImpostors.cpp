@@ -0,0 +1,360 @@
+#include "XPMPImpostors.h"
+#include "XPMPAllocations.h"
+#include "XPMPMultiplayerCSL.h"
+#include "XPMPMultiplayerObj.h"
+#include "XOGLUtils.h"
+
+#include "XPLMGraphics.h"
+#include "XPLMProcessing.h"
+#include "XPLMUtilities.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+// The atlas is split into square cells, one view of one model each.
+static const int	kAtlasSize = 2048;
+static const int	kCellSize = 64;
+static const int	kCellsPerRow = kAtlasSize / kCellSize;
+
+// Every model is baked from kHeadings directions around it, at kPitches heights.
+static const int	kHeadings = 12;
+static const int	kPitches = 3;
+static const float	kPitchAngles[kPitches] = { -15.0f, 15.0f, 45.0f };	// How far above the plane the viewer is, in degrees
+static const int	kCellsPerModel = kHeadings * kPitches;
+static const int	kSlots = (kCellsPerRow * kCellsPerRow) / kCellsPerModel;
+
+// Half the size of the box we bake a model into, in meters - the same as the renderer's culling radius.
+static const float	kImpostorRadius = 50.0f;
+
+// Baking isn't free, so we only do a few views per frame.
+static const int	kBakeCellsPerFrame = 6;
+
+static const double	kDegToRad = 3.14159265358979323846 / 180.0;
+
+struct ImpostorSlot_t {
+	std::shared_ptr<void>	key;				// What the slot shows, see impostor_key - we keep it alive, so it can't be reused
+	XPMPPlanePtr			source = nullptr;	// A plane to bake from, only valid during the frame it was requested in
+	int						baked = 0;			// Views done so far
+	int						lastUsed = -1;		// Cycle number
+};
+
+static ImpostorSlot_t	gSlots[kSlots];
+static int				gAtlasTexture = 0;
+static GLuint			gFramebuffer = 0;
+static GLuint			gDepthBuffer = 0;
+static bool				gInitTried = false;
+static bool				gAvailable = false;
+
+static std::vector<float>	gVertices;
+static std::vector<float>	gTexCoords;
+
+static bool init_atlas()
+{
+	gInitTried = true;
+	if (!OGL_HasFramebuffers())
+	{
+		XPLMDebugString(XPMP_CLIENT_NAME ": No framebuffer objects, so no impostors.\n");
+		return false;
+	}
+
+	XPLMGenerateTextureNumbers(&gAtlasTexture, 1);
+	OGL_BindTexture2d(gAtlasTexture, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, kAtlasSize, kAtlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	GLint oldFramebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &oldFramebuffer);
+
+	glGenRenderbuffersEXT(1, &gDepthBuffer);
+	glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, gDepthBuffer);
+	glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT24, kAtlasSize, kAtlasSize);
+
+	glGenFramebuffersEXT(1, &gFramebuffer);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, gFramebuffer);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, static_cast<GLuint>(gAtlasTexture), 0);
+	glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, gDepthBuffer);
+	const GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+
+	// Start with a clear atlas.
+	if (status == GL_FRAMEBUFFER_COMPLETE_EXT)
+	{
+		glPushAttrib(GL_COLOR_BUFFER_BIT | GL_VIEWPORT_BIT);
+		glViewport(0, 0, kAtlasSize, kAtlasSize);
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glPopAttrib();
+	}
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, static_cast<GLuint>(oldFramebuffer));
+
+	if (status != GL_FRAMEBUFFER_COMPLETE_EXT)
+	{
+		XPLMDebugString(XPMP_CLIENT_NAME ": Could not set up the impostor atlas, so no impostors.\n");
+		IMP_Cleanup();
+		return false;
+	}
+	return true;
+}
+
+// What an impostor of this plane would show: its livery texture or object.  Null if it isn't loaded yet.
+static std::shared_ptr<void> impostor_key(XPMPPlanePtr plane)
+{
+	switch (plane->model->plane_type) {
+	case plane_Obj:
+	{
+		auto obj = std::atomic_load(&plane->objHandle);
+		if (!obj || obj->loadStatus != Succeeded) { return nullptr; }
+		auto tex = std::atomic_load(&plane->texHandle);
+		if (!tex) { return obj; }
+		// The texture only gets uploaded once the plane has been drawn the normal way.
+		if (tex->loadStatus != Succeeded || !tex->id) { return nullptr; }
+		return tex;
+	}
+	case plane_Obj8:
+	{
+		if (!plane->allObj8Loaded) { return nullptr; }
+		for (const auto &pair : plane->obj8Handles)
+		{
+			auto obj8 = std::atomic_load(&pair.second);
+			if (obj8) { return obj8; }
+		}
+		return nullptr;
+	}
+	default:
+		return nullptr;
+	}
+}
+
+int		IMP_Request(XPMPPlanePtr plane)
+{
+	if (!gInitTried) { gAvailable = init_atlas(); }
+	if (!gAvailable || !plane->model) { return -1; }
+
+	std::shared_ptr<void> key = impostor_key(plane);
+	if (!key) { return -1; }
+
+	const int cycle = XPLMGetCycleNumber();
+	int victim = -1;
+	for (int s = 0; s < kSlots; ++s)
+	{
+		ImpostorSlot_t &slot = gSlots[s];
+		if (slot.key == key)
+		{
+			slot.lastUsed = cycle;
+			if (slot.baked == kCellsPerModel) { return s; }
+			if (!slot.source) { slot.source = plane; }
+			return -1;
+		}
+		// Never take a slot that is in use this frame.
+		if (slot.lastUsed != cycle && (victim < 0 || slot.lastUsed < gSlots[victim].lastUsed))
+			victim = s;
+	}
+
+	if (victim >= 0)
+	{
+		ImpostorSlot_t &slot = gSlots[victim];
+		slot.key = key;
+		slot.source = plane;
+		slot.baked = 0;
+		slot.lastUsed = cycle;
+	}
+	return -1;
+}
+
+// Where a view of a slot lives in the atlas, in cells.
+static void cell_position(int slot, int view, int * outCol, int * outRow)
+{
+	const int cell = slot * kCellsPerModel + view;
+	*outCol = cell % kCellsPerRow;
+	*outRow = cell / kCellsPerRow;
+}
+
+static void bake_view(const ImpostorSlot_t &slot, int slotIndex, int view, const FrameContext_t &context)
+{
+	const int heading = view % kHeadings;
+	const int pitch = view / kHeadings;
+	const double azimuth = heading * (360.0 / kHeadings) * kDegToRad;
+	const double elevation = kPitchAngles[pitch] * kDegToRad;
+
+	int col, row;
+	cell_position(slotIndex, view, &col, &row);
+	glViewport(col * kCellSize, row * kCellSize, kCellSize, kCellSize);
+	glScissor(col * kCellSize, row * kCellSize, kCellSize, kCellSize);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Look at a plane sitting at the origin and facing north (-Z), from the given direction.
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(-kImpostorRadius, kImpostorRadius, -kImpostorRadius, kImpostorRadius, 0.0, 4.0 * kImpostorRadius);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	const double distance = 2.0 * kImpostorRadius;
+	gluLookAt(distance * sin(azimuth) * cos(elevation), distance * sin(elevation), -distance * cos(azimuth) * cos(elevation),
+			  0.0, 0.0, 0.0,
+			  0.0, 1.0, 0.0);
+
+	XPLMPlaneDrawState_t state;
+	state.structSize = sizeof(state);
+	state.gearPosition = 1.0f;
+	state.flapRatio = state.spoilerRatio = state.speedBrakeRatio = state.slatRatio = state.wingSweep = 0.0f;
+	state.thrust = 0.0f;
+	state.yokePitch = state.yokeHeading = state.yokeRoll = 0.0f;
+
+	xpmp_LightStatus noLights;
+	noLights.lightFlags = 0;
+
+	// The last view may have been an OBJ8, and X-Plane sets its state behind the cache's back.
+	OGL_ResetStateCache();
+	const int type = (slot.source->model->plane_type == plane_Obj8) ? plane_Obj8 : plane_Obj;
+	if (type == plane_Obj)
+		OGL_SetGraphicsState(0, 1, 0, 1, 1, 1, 1);
+	CSL_DrawObject(slot.source, 0.0f, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, type, lod_Full, noLights, &state, nullptr, context);
+}
+
+void	IMP_Bake(const FrameContext_t & context)
+{
+	if (!gAvailable) { return; }
+
+	int budget = kBakeCellsPerFrame;
+	bool begun = false;
+	GLint oldFramebuffer = 0;
+	for (int s = 0; s < kSlots && budget > 0; ++s)
+	{
+		ImpostorSlot_t &slot = gSlots[s];
+		if (!slot.source) { continue; }
+
+		if (!begun)
+		{
+			begun = true;
+			glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &oldFramebuffer);
+			glPushAttrib(GL_COLOR_BUFFER_BIT | GL_SCISSOR_BIT | GL_VIEWPORT_BIT);
+			glMatrixMode(GL_PROJECTION);
+			glPushMatrix();
+			glMatrixMode(GL_MODELVIEW);
+			glPushMatrix();
+			glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, gFramebuffer);
+			glEnable(GL_SCISSOR_TEST);
+			glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		}
+
+		for (; slot.baked < kCellsPerModel && budget > 0; ++slot.baked, --budget)
+			bake_view(slot, s, slot.baked, context);
+	}
+
+	if (begun)
+	{
+		OGL_ResetStateCache();
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, static_cast<GLuint>(oldFramebuffer));
+		glMatrixMode(GL_PROJECTION);
+		glPopMatrix();
+		glMatrixMode(GL_MODELVIEW);
+		glPopMatrix();
+		glPopAttrib();
+	}
+
+	// The planes we baked from may be gone by the next frame.
+	for (auto &slot : gSlots)
+		slot.source = nullptr;
+}
+
+void	IMP_Draw(const float * modelView, const float eye[3], const std::vector<ImpostorInstance_t> & instances)
+{
+	if (instances.empty()) { return; }
+
+	// The camera's right and up vectors, to build the quads from.
+	const float rx = modelView[0] * kImpostorRadius, ry = modelView[4] * kImpostorRadius, rz = modelView[ 8] * kImpostorRadius;
+	const float ux = modelView[1] * kImpostorRadius, uy = modelView[5] * kImpostorRadius, uz = modelView[ 9] * kImpostorRadius;
+	const float cellUV = static_cast<float>(kCellSize) / kAtlasSize;
+
+	gVertices.clear();
+	gTexCoords.clear();
+	for (const auto &instance : instances)
+	{
+		// Which of the baked views is closest to how we see the plane?
+		const float dx = eye[0] - instance.x;
+		const float dy = eye[1] - instance.y;
+		const float dz = eye[2] - instance.z;
+		const float azimuth = static_cast<float>(atan2(dx, -dz) / kDegToRad) - instance.heading;
+		const float elevation = static_cast<float>(atan2(dy, sqrt(dx*dx + dz*dz)) / kDegToRad);
+
+		int heading = static_cast<int>(floor(azimuth * kHeadings / 360.0f + 0.5f)) % kHeadings;
+		if (heading < 0) { heading += kHeadings; }
+		int pitch = 0;
+		for (int p = 1; p < kPitches; ++p)
+			if (fabs(elevation - kPitchAngles[p]) < fabs(elevation - kPitchAngles[pitch]))
+				pitch = p;
+
+		int col, row;
+		cell_position(instance.slot, pitch * kHeadings + heading, &col, &row);
+		const float u0 = col * cellUV, u1 = u0 + cellUV;
+		const float v0 = row * cellUV, v1 = v0 + cellUV;
+
+		const float quad[4][5] = {
+			{ instance.x - rx - ux, instance.y - ry - uy, instance.z - rz - uz, u0, v0 },
+			{ instance.x + rx - ux, instance.y + ry - uy, instance.z + rz - uz, u1, v0 },
+			{ instance.x + rx + ux, instance.y + ry + uy, instance.z + rz + uz, u1, v1 },
+			{ instance.x - rx + ux, instance.y - ry + uy, instance.z - rz + uz, u0, v1 }
+		};
+		for (const auto &corner : quad)
+		{
+			gVertices.insert(gVertices.end(), corner, corner + 3);
+			gTexCoords.insert(gTexCoords.end(), corner + 3, corner + 5);
+		}
+	}
+	ALLOC_NoteCapacity(gVertices);
+	ALLOC_NoteCapacity(gTexCoords);
+
+	// Through the cache, so whatever draws after us doesn't trust a state we changed.
+	OGL_ResetStateCache();
+	OGL_SetGraphicsState(1, 1, 0, 1, 0, 1, 1);
+	OGL_BindTexture2d(gAtlasTexture, 0);
+	glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+
+	// Our arrays live in our memory, so get X-Plane's VBO out of the way and keep its client state.
+	GLint xpBuffer = 0;
+#if IBM
+	if(glBindBufferARB)
+#endif
+	{
+		glGetIntegerv(GL_ARRAY_BUFFER_BINDING_ARB, &xpBuffer);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	}
+	glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, gVertices.data());
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE1);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE0);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glTexCoordPointer(2, GL_FLOAT, 0, gTexCoords.data());
+
+	glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(gVertices.size() / 3));
+
+	glPopClientAttrib();
+#if IBM
+	if(glBindBufferARB)
+#endif
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, xpBuffer);
+}
+
+void	IMP_Cleanup()
+{
+	for (auto &slot : gSlots)
+		slot = ImpostorSlot_t();
+	if (gFramebuffer) { glDeleteFramebuffersEXT(1, &gFramebuffer); gFramebuffer = 0; }
+	if (gDepthBuffer) { glDeleteRenderbuffersEXT(1, &gDepthBuffer); gDepthBuffer = 0; }
+	if (gAtlasTexture)
+	{
+		const GLuint texture = static_cast<GLuint>(gAtlasTexture);
+		glDeleteTextures(1, &texture);
+		gAtlasTexture = 0;
+	}
+	gAvailable = false;
+	gInitTried = false;
+}
@@ -0,0 +1,69 @@
+#ifndef XPMPIMPOSTORS_H
+#define XPMPIMPOSTORS_H
+
+#include "XPMPMultiplayerVars.h"
+
+#include <vector>
+
+struct FrameContext_t;
+
+/*
+ * XPMPImpostors
+ *
+ * Far away planes are only a few pixels big, but drawing one is still a full OBJ draw.  Instead
+ * we render each model once, offscreen, into a sprite atlas - from a dozen headings and a few
+ * heights - and draw far planes as camera facing quads cut from that atlas, all of them with
+ * one draw call.
+ *
+ * A model gets a slot in the atlas the first time it is asked for, and the slot is baked a few
+ * views per frame from one of the planes using it.  When the atlas is full, the model that was
+ * used least recently gives up its slot.  Without framebuffer objects, nothing is an impostor.
+ *
+ * All of this has to run inside a draw callback.
+ *
+ */
+
+// One plane to draw as an impostor.
+struct ImpostorInstance_t {
+	float	x;
+	float	y;
+	float	z;
+	float	heading;
+	int		slot;
+};
+
+/*
+ * IMP_Request
+ *
+ * Returns the atlas slot to draw this plane with, or -1 if it has to be drawn as a model for now.
+ * Models that aren't baked yet get queued for baking.
+ *
+ */
+int		IMP_Request(XPMPPlanePtr plane);
+
+/*
+ * IMP_Draw
+ *
+ * Draws all the impostors with one draw call.  Takes the current model view matrix, for the
+ * camera's orientation, and the camera's position.
+ *
+ */
+void	IMP_Draw(const float * modelView, const float eye[3], const std::vector<ImpostorInstance_t> & instances);
+
+/*
+ * IMP_Bake
+ *
+ * Renders a few more views of the models requested this frame.  Call after drawing, from a solid pass.
+ *
+ */
+void	IMP_Bake(const FrameContext_t & context);
+
+/*
+ * IMP_Cleanup
+ *
+ * Releases the atlas and everything it holds on to.
+ *
+ */
+void	IMP_Cleanup();
+
+#endif
@@ -0,0 +1,120 @@
+#include "XPMPInstances.h"
+
+#if XPMP_INSTANCING
+
+#include "XPMPMultiplayerVars.h"
+#include "XPMPMultiplayerObj8.h"
+
+#include "XPLMInstance.h"
+
+#include <unordered_map>
+#include <vector>
+
+struct AttachmentInstance_t {
+	OBJ8Handle		object;		// Keeps the object loaded for as long as the instance lives
+	XPLMInstanceRef	instance;
+};
+
+struct PlaneInstances_t {
+	std::vector<AttachmentInstance_t>	attachments;	// In the order of the plane's obj8Handles
+	unsigned							frame = 0;		// When we last moved them
+};
+
+static std::unordered_map<XPMPPlane_t *, PlaneInstances_t>	gInstancedPlanes;
+static unsigned					gFrame = 0;
+static std::vector<float>		gValues;			// One plane's dataref values
+
+static void destroy_instances(PlaneInstances_t &planeInstances)
+{
+	for (auto &attachment : planeInstances.attachments)
+		XPLMDestroyInstance(attachment.instance);
+	planeInstances.attachments.clear();
+}
+
+// Do the instances still show what the plane's model is made of?
+static bool instances_current(const XPMPPlane_t * plane, const PlaneInstances_t &planeInstances)
+{
+	if (planeInstances.attachments.size() != plane->obj8Handles.size()) { return false; }
+	std::size_t n = 0;
+	for (const auto &pair : plane->obj8Handles)
+		if (std::atomic_load(&pair.second) != planeInstances.attachments[n++].object)
+			return false;
+	return true;
+}
+
+static bool create_instances(const XPMPPlane_t * plane, PlaneInstances_t &planeInstances)
+{
+	for (const auto &pair : plane->obj8Handles)
+	{
+		OBJ8Handle object = std::atomic_load(&pair.second);
+		if (!object || !object->objectRef)
+		{
+			destroy_instances(planeInstances);
+			return false;
+		}
+		XPLMInstanceRef instance = XPLMCreateInstance(object->objectRef, OBJ8_DatarefNames());
+		if (!instance)
+		{
+			destroy_instances(planeInstances);
+			return false;
+		}
+		planeInstances.attachments.push_back({ object, instance });
+	}
+	return true;
+}
+
+void	INST_BeginFrame()
+{
+	++gFrame;
+}
+
+bool	INST_UpdatePlane(XPMPPlane_t * plane, const XPLMDrawInfo_t &location, const XPLMPlaneDrawState_t &state,
+						 xpmp_LightStatus lights)
+{
+	if (!plane->model || plane->model->plane_type != plane_Obj8 || !plane->allObj8Loaded) { return false; }
+
+	PlaneInstances_t &planeInstances = gInstancedPlanes[plane];
+	if (!instances_current(plane, planeInstances))
+	{
+		destroy_instances(planeInstances);
+		if (!create_instances(plane, planeInstances)) { return false; }
+	}
+
+	gValues.resize(static_cast<std::size_t>(OBJ8_DatarefCount()));
+	OBJ8_DatarefValues(state, lights, gValues.data());
+	for (const auto &attachment : planeInstances.attachments)
+		XPLMInstanceSetPosition(attachment.instance, &location, gValues.data());
+	planeInstances.frame = gFrame;
+	return true;
+}
+
+void	INST_EndFrame()
+{
+	for (auto it = gInstancedPlanes.begin(); it != gInstancedPlanes.end(); )
+	{
+		if (it->second.frame != gFrame)
+		{
+			destroy_instances(it->second);
+			it = gInstancedPlanes.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+void	INST_ForgetPlane(XPMPPlane_t * plane)
+{
+	auto it = gInstancedPlanes.find(plane);
+	if (it == gInstancedPlanes.end()) { return; }
+	destroy_instances(it->second);
+	gInstancedPlanes.erase(it);
+}
+
+void	INST_Cleanup()
+{
+	for (auto &pair : gInstancedPlanes)
+		destroy_instances(pair.second);
+	gInstancedPlanes.clear();
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef XPMPINSTANCES_H
+#define XPMPINSTANCES_H
+
+#include "XPLMPlanes.h"
+#include "XPLMScenery.h"
+#include "XPMPMultiplayer.h"
+
+/*
+ * XPMPInstances
+ *
+ * Built with XPMP_INSTANCING (the XPMP_INSTANCING CMake option, needs X-Plane 11), OBJ8 planes
+ * aren't drawn from our draw callbacks at all.  Every attachment of a plane becomes an
+ * XPLMInstanceRef, and once per frame the flight loop hands X-Plane the plane's position and the
+ * values of our libxplanemp/controls datarefs for it.  X-Plane then culls and batches the
+ * instances itself, together with its own objects.
+ *
+ * X-Plane also picks the LOD and the lighting of an instance, so every attachment is drawn the way
+ * it is up close, the plane's night texture setting doesn't apply and there are no impostors.
+ *
+ * We only talk to X-Plane through XPLMCreateInstance, XPLMInstanceSetPosition and
+ * XPLMDestroyInstance here, so this runs just as well against a stub of those - see
+ * test/XPMPInstancesTest.cpp, built with XPMP_BUILD_TESTS.  Call from the main thread.
+ *
+ */
+
+struct XPMPPlane_t;
+
+#if XPMP_INSTANCING
+
+/*
+ * INST_BeginFrame, INST_EndFrame
+ *
+ * Bracket the INST_UpdatePlane calls of one frame.  Planes that didn't get an update in between
+ * lose their instances.
+ *
+ */
+void	INST_BeginFrame();
+void	INST_EndFrame();
+
+/*
+ * INST_UpdatePlane
+ *
+ * Moves the plane's instances, creating them first if the plane doesn't have them yet or its model
+ * changed.  Returns false if the plane can't be drawn as instances - it isn't an OBJ8 plane, or it
+ * isn't loaded yet - and has to be drawn the normal way.
+ *
+ */
+bool	INST_UpdatePlane(XPMPPlane_t * plane, const XPLMDrawInfo_t &location, const XPLMPlaneDrawState_t &state,
+						 xpmp_LightStatus lights);
+
+/*
+ * INST_ForgetPlane
+ *
+ * Destroys the plane's instances right away, for a plane that is going away.
+ *
+ */
+void	INST_ForgetPlane(XPMPPlane_t * plane);
+
+/*
+ * INST_Cleanup
+ *
+ * Destroys all instances.
+ *
+ */
+void	INST_Cleanup();
+
+#endif
+
+#endif
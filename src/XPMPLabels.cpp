@@ -0,0 +1,414 @@
+#include "XPMPLabels.h"
+#include "XPMPAllocations.h"
+#include "XPMPMultiplayer.h"
+#include "XOGLUtils.h"
+
+#include "XPLMGraphics.h"
+#include "XPLMProcessing.h"
+#include "XPLMUtilities.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+// The atlas holds the printable ASCII characters, in rows of cells.
+static const int	kFirstGlyph = 32;		// ' '
+static const int	kLastGlyph = 126;		// '~'
+static const int	kGlyphsPerRow = 16;
+static const int	kGlyphRows = (kLastGlyph - kFirstGlyph) / kGlyphsPerRow + 1;
+
+// A label that wasn't drawn for this many frames loses its layout.
+static const int	kLayoutKeepFrames = 300;
+
+static const std::size_t	kMaxLabelLength = sizeof(XPMPPlanePosition_t::label);
+
+// The declutter grid's buckets, in pixels.
+static const int	kBucketWidth = 64;
+static const int	kBucketHeight = 32;
+
+static int		gAtlasTexture = 0;
+static bool		gInitTried = false;
+static bool		gAvailable = false;
+
+// The basic font is fixed width.  A cell is as wide as a glyph and twice as high, with the glyph's
+// origin a quarter up, so descenders and anything tall still fit.
+static int		gGlyphWidth = 0;
+static int		gGlyphHeight = 0;
+static int		gCellWidth = 0;
+static int		gCellHeight = 0;
+static int		gAtlasWidth = 0;
+static int		gAtlasHeight = 0;
+
+// Label texts as hash keys - a fixed size copy, so looking one up doesn't allocate.
+struct LabelText_t {
+	char	text[kMaxLabelLength];
+
+	bool operator==(const LabelText_t &other) const { return std::memcmp(text, other.text, kMaxLabelLength) == 0; }
+};
+
+struct LabelTextHash_t {
+	std::size_t operator()(const LabelText_t &key) const
+	{
+		// FNV-1a
+		std::size_t hash = 2166136261u;
+		for (std::size_t n = 0; n < kMaxLabelLength && key.text[n]; ++n)
+			hash = (hash ^ static_cast<unsigned char>(key.text[n])) * 16777619u;
+		return hash;
+	}
+};
+
+struct LabelLayout_t {
+	std::vector<float>	corners;		// x, y, s, t per quad corner, relative to where the label goes
+	int					lastUsed = 0;	// Cycle number
+};
+
+static std::unordered_map<LabelText_t, LabelLayout_t, LabelTextHash_t>	gLayouts;
+static int					gLastPrune = 0;
+
+static std::vector<float>	gVertices;		// x, y, s, t per quad corner, all labels of the frame
+
+// Where a label covers the screen.
+struct LabelBox_t {
+	float	x0, y0, x1, y1;
+};
+
+// The declutter grid: one list of labels per bucket, chained through gBucketEntries.
+struct BucketEntry_t {
+	int		label;			// Into gKept
+	int		next;			// Into gBucketEntries, or -1
+};
+static std::vector<int>				gBuckets;
+static std::vector<BucketEntry_t>	gBucketEntries;
+static std::vector<uint64_t>		gOrder;			// Priority in the high half, index in the low half
+static std::vector<LabelInstance_t>	gKept;
+static std::vector<LabelBox_t>		gKeptBoxes;
+
+static void read_font_size()
+{
+	if (gGlyphWidth > 0 && gGlyphHeight > 0) { return; }
+	int digitsOnly = 0;
+	XPLMGetFontDimensions(xplmFont_Basic, &gGlyphWidth, &gGlyphHeight, &digitsOnly);
+}
+
+static inline float text_width(const char * text)
+{
+	return static_cast<float>(strnlen(text, kMaxLabelLength) * gGlyphWidth);
+}
+
+// Draws every glyph once into the atlas.
+static void bake_glyphs()
+{
+	glPushAttrib(GL_COLOR_BUFFER_BIT | GL_VIEWPORT_BIT);
+	glViewport(0, 0, gAtlasWidth, gAtlasHeight);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, gAtlasWidth, 0, gAtlasHeight, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	// White, so the label's color can modulate it.
+	float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	char glyph[2] = { 0, 0 };
+	for (int c = kFirstGlyph; c <= kLastGlyph; ++c)
+	{
+		const int index = c - kFirstGlyph;
+		glyph[0] = static_cast<char>(c);
+		XPLMDrawString(white, (index % kGlyphsPerRow) * gCellWidth, (index / kGlyphsPerRow) * gCellHeight + gGlyphHeight / 2,
+					   glyph, nullptr, xplmFont_Basic);
+	}
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	glPopAttrib();
+}
+
+static bool init_atlas()
+{
+	gInitTried = true;
+	if (!OGL_HasFramebuffers())
+	{
+		XPLMDebugString(XPMP_CLIENT_NAME ": No framebuffer objects, so labels are drawn one by one.\n");
+		return false;
+	}
+
+	read_font_size();
+	if (gGlyphWidth <= 0 || gGlyphHeight <= 0)
+		return false;
+	gCellWidth = gGlyphWidth;
+	gCellHeight = 2 * gGlyphHeight;
+	gAtlasWidth = kGlyphsPerRow * gCellWidth;
+	gAtlasHeight = kGlyphRows * gCellHeight;
+
+	// Glyphs are drawn at whole pixels and the size they were baked at, so no filtering.
+	XPLMGenerateTextureNumbers(&gAtlasTexture, 1);
+	XPLMBindTexture2d(gAtlasTexture, 0);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, gAtlasWidth, gAtlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	GLint oldFramebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &oldFramebuffer);
+
+	GLuint framebuffer = 0;
+	glGenFramebuffersEXT(1, &framebuffer);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, framebuffer);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, static_cast<GLuint>(gAtlasTexture), 0);
+	const GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+	if (status == GL_FRAMEBUFFER_COMPLETE_EXT)
+		bake_glyphs();
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, static_cast<GLuint>(oldFramebuffer));
+
+	// The atlas never changes again, so we don't need the framebuffer anymore.
+	glDeleteFramebuffersEXT(1, &framebuffer);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE_EXT)
+	{
+		XPLMDebugString(XPMP_CLIENT_NAME ": Could not set up the label atlas, so labels are drawn one by one.\n");
+		LABEL_Cleanup();
+		gInitTried = true;
+		return false;
+	}
+	return true;
+}
+
+static void build_layout(const char * text, LabelLayout_t &layout)
+{
+	const float cellS = static_cast<float>(gCellWidth) / gAtlasWidth;
+	const float cellT = static_cast<float>(gCellHeight) / gAtlasHeight;
+	const float bottom = -static_cast<float>(gGlyphHeight / 2);
+
+	layout.corners.clear();
+	for (std::size_t n = 0; n < kMaxLabelLength && text[n]; ++n)
+	{
+		int c = static_cast<unsigned char>(text[n]);
+		if (c == ' ') { continue; }
+		if (c < kFirstGlyph || c > kLastGlyph) { c = '?'; }
+
+		const int index = c - kFirstGlyph;
+		const float s0 = (index % kGlyphsPerRow) * cellS, s1 = s0 + cellS;
+		const float t0 = (index / kGlyphsPerRow) * cellT, t1 = t0 + cellT;
+		const float x0 = static_cast<float>(n * gGlyphWidth), x1 = x0 + gCellWidth;
+		const float y0 = bottom, y1 = y0 + gCellHeight;
+
+		const float quad[16] = {
+			x0, y0, s0, t0,
+			x1, y0, s1, t0,
+			x1, y1, s1, t1,
+			x0, y1, s0, t1
+		};
+		layout.corners.insert(layout.corners.end(), quad, quad + 16);
+	}
+}
+
+static const LabelLayout_t &layout_for(const char * text, int cycle)
+{
+	LabelText_t key;
+	std::strncpy(key.text, text, kMaxLabelLength);
+	key.text[kMaxLabelLength - 1] = 0;
+
+	LabelLayout_t &layout = gLayouts[key];
+	if (layout.corners.empty())
+	{
+		ALLOC_NoteGrowth();		// A text we haven't seen lately - caching it allocates
+		build_layout(key.text, layout);
+	}
+	layout.lastUsed = cycle;
+	return layout;
+}
+
+void	LABEL_Declutter(std::vector<LabelInstance_t> & labels, float screenWidth, float screenHeight, int maxLabels)
+{
+	read_font_size();
+	const int cols = std::max(static_cast<int>(std::ceil(screenWidth / kBucketWidth)), 1);
+	const int rows = std::max(static_cast<int>(std::ceil(screenHeight / kBucketHeight)), 1);
+	gBuckets.assign(static_cast<std::size_t>(cols * rows), -1);
+	gBucketEntries.clear();
+	gKept.clear();
+	gKeptBoxes.clear();
+
+	// Higher priorities first, then in the order we got them.  Flipping the sign bit makes the
+	// priority sort like an unsigned number, inverting it puts the high ones first.
+	gOrder.clear();
+	for (std::size_t n = 0; n < labels.size(); ++n)
+	{
+		const uint32_t priority = ~(static_cast<uint32_t>(labels[n].priority) ^ 0x80000000u);
+		gOrder.push_back((static_cast<uint64_t>(priority) << 32) | static_cast<uint32_t>(n));
+	}
+	std::sort(gOrder.begin(), gOrder.end());
+
+	for (uint64_t order : gOrder)
+	{
+		const LabelInstance_t &label = labels[static_cast<std::size_t>(order & 0xFFFFFFFFu)];
+		const LabelBox_t box = { label.x, label.y, label.x + text_width(label.text), label.y + static_cast<float>(gGlyphHeight) };
+		if (box.x1 <= 0.0f || box.x0 >= screenWidth || box.y1 <= 0.0f || box.y0 >= screenHeight)
+			continue;
+
+		const int c0 = std::max(static_cast<int>(box.x0) / kBucketWidth, 0);
+		const int c1 = std::min(static_cast<int>(box.x1) / kBucketWidth, cols - 1);
+		const int r0 = std::max(static_cast<int>(box.y0) / kBucketHeight, 0);
+		const int r1 = std::min(static_cast<int>(box.y1) / kBucketHeight, rows - 1);
+
+		int winner = -1;
+		for (int r = r0; r <= r1 && winner < 0; ++r)
+			for (int c = c0; c <= c1 && winner < 0; ++c)
+				for (int e = gBuckets[r * cols + c]; e >= 0 && winner < 0; e = gBucketEntries[e].next)
+				{
+					const LabelBox_t &other = gKeptBoxes[gBucketEntries[e].label];
+					if (box.x0 < other.x1 && other.x0 < box.x1 && box.y0 < other.y1 && other.y0 < box.y1)
+						winner = gBucketEntries[e].label;
+				}
+
+		if (winner >= 0)
+		{
+			++gKept[winner].hidden;
+			continue;
+		}
+		if (static_cast<int>(gKept.size()) >= maxLabels)
+			continue;
+
+		const int kept = static_cast<int>(gKept.size());
+		gKept.push_back(label);
+		gKept.back().hidden = 0;
+		gKeptBoxes.push_back(box);
+		for (int r = r0; r <= r1; ++r)
+			for (int c = c0; c <= c1; ++c)
+			{
+				gBucketEntries.push_back({ kept, gBuckets[r * cols + c] });
+				gBuckets[r * cols + c] = static_cast<int>(gBucketEntries.size()) - 1;
+			}
+	}
+
+	labels.assign(gKept.begin(), gKept.end());
+
+	ALLOC_NoteCapacity(gBuckets);
+	ALLOC_NoteCapacity(gBucketEntries);
+	ALLOC_NoteCapacity(gOrder);
+	ALLOC_NoteCapacity(gKept);
+	ALLOC_NoteCapacity(gKeptBoxes);
+}
+
+// Appends a text's quads at a position, from its cached layout.
+static void push_text(const char * text, float x, float y, int cycle)
+{
+	const std::vector<float> &corners = layout_for(text, cycle).corners;
+	for (std::size_t n = 0; n < corners.size(); n += 4)
+	{
+		gVertices.push_back(corners[n] + x);
+		gVertices.push_back(corners[n + 1] + y);
+		gVertices.push_back(corners[n + 2]);
+		gVertices.push_back(corners[n + 3]);
+	}
+}
+
+void	LABEL_Draw(const std::vector<LabelInstance_t> & labels, const float color[4])
+{
+	if (labels.empty()) { return; }
+	if (!gInitTried) { gAvailable = init_atlas(); }
+
+	float labelColor[4] = { color[0], color[1], color[2], color[3] };
+	char hidden[16];
+	if (!gAvailable)
+	{
+		XPLMSetGraphicsState(0, 0, 0, 0, 1, 1, 0);
+		for (const auto &label : labels)
+		{
+			XPLMDrawString(labelColor, static_cast<int>(label.x), static_cast<int>(label.y), const_cast<char *>(label.text), nullptr, xplmFont_Basic);
+			if (label.hidden > 0)
+			{
+				snprintf(hidden, sizeof(hidden), " +%d", label.hidden);
+				XPLMDrawString(labelColor, static_cast<int>(label.x + text_width(label.text)), static_cast<int>(label.y), hidden, nullptr, xplmFont_Basic);
+			}
+		}
+		return;
+	}
+
+	const int cycle = XPLMGetCycleNumber();
+	gVertices.clear();
+	for (const auto &label : labels)
+	{
+		// Whole pixels, or the glyphs get blurry.
+		const float x = std::floor(label.x + 0.5f);
+		const float y = std::floor(label.y + 0.5f);
+		push_text(label.text, x, y, cycle);
+		if (label.hidden > 0)
+		{
+			snprintf(hidden, sizeof(hidden), " +%d", label.hidden);
+			push_text(hidden, x + text_width(label.text), y, cycle);
+		}
+	}
+	ALLOC_NoteCapacity(gVertices);
+
+	// Forget the layouts of labels we haven't seen in a while.
+	if (cycle - gLastPrune > kLayoutKeepFrames)
+	{
+		for (auto it = gLayouts.begin(); it != gLayouts.end(); )
+		{
+			if (cycle - it->second.lastUsed > kLayoutKeepFrames)
+				it = gLayouts.erase(it);
+			else
+				++it;
+		}
+		gLastPrune = cycle;
+	}
+
+	if (gVertices.empty()) { return; }
+
+	XPLMSetGraphicsState(0, 1, 0, 0, 1, 0, 0);
+	XPLMBindTexture2d(gAtlasTexture, 0);
+	glColor4fv(labelColor);
+
+	// Our arrays live in our memory, so get X-Plane's VBO out of the way and keep its client state.
+	GLint xpBuffer = 0;
+#if IBM
+	if(glBindBufferARB)
+#endif
+	{
+		glGetIntegerv(GL_ARRAY_BUFFER_BINDING_ARB, &xpBuffer);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	}
+	glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+
+	const GLsizei stride = 4 * sizeof(float);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_FLOAT, stride, gVertices.data());
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE1);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE0);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glTexCoordPointer(2, GL_FLOAT, stride, gVertices.data() + 2);
+
+	glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(gVertices.size() / 4));
+
+	glPopClientAttrib();
+#if IBM
+	if(glBindBufferARB)
+#endif
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, xpBuffer);
+}
+
+void	LABEL_Cleanup()
+{
+	gLayouts.clear();
+	if (gAtlasTexture)
+	{
+		const GLuint texture = static_cast<GLuint>(gAtlasTexture);
+		glDeleteTextures(1, &texture);
+		gAtlasTexture = 0;
+	}
+	gInitTried = false;
+	gAvailable = false;
+}
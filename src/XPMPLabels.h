@@ -0,0 +1,63 @@
+#ifndef XPMPLABELS_H
+#define XPMPLABELS_H
+
+#include <vector>
+
+/*
+ * XPMPLabels
+ *
+ * XPLMDrawString sets up its state and lays out its glyphs again on every call, and we used to
+ * make one call per label.  Instead we draw every printable ASCII character of X-Plane's basic
+ * font once, offscreen, into a glyph atlas, and draw all labels as textured quads with one draw
+ * call.
+ *
+ * The basic font is fixed width, so a label's layout only depends on its text.  Layouts are
+ * cached by text, and a label that didn't change since the last frame is just copied over.
+ * Without framebuffer objects, we fall back to XPLMDrawString.
+ *
+ * Before that, LABEL_Declutter makes sure labels don't pile up into an unreadable block over a
+ * busy apron.
+ *
+ * All of this has to run inside a 2-d draw callback.
+ *
+ */
+
+// One label to draw, in window coordinates.
+struct LabelInstance_t {
+	float		x;
+	float		y;
+	const char *text;
+	int			priority;
+	int			hidden;		// Labels this one won against, set by LABEL_Declutter
+};
+
+/*
+ * LABEL_Declutter
+ *
+ * Drops the labels that are off screen or would overlap a label that matters more, and keeps at
+ * most maxLabels of the rest.  A label with a higher priority matters more; with the same
+ * priority, the one that comes first does - so pass them closest first.  A label that hides others
+ * shows how many, like "DLH123 +3".
+ *
+ * Overlaps are found with a grid of screen buckets, so this is about linear in the labels.
+ *
+ */
+void	LABEL_Declutter(std::vector<LabelInstance_t> & labels, float screenWidth, float screenHeight, int maxLabels);
+
+/*
+ * LABEL_Draw
+ *
+ * Draws all the labels in the given color.
+ *
+ */
+void	LABEL_Draw(const std::vector<LabelInstance_t> & labels, const float color[4]);
+
+/*
+ * LABEL_Cleanup
+ *
+ * Releases the atlas and the cached layouts.
+ *
+ */
+void	LABEL_Cleanup();
+
+#endif
@@ -0,0 +1,275 @@
+#include "XPMPLocalFrame.h"
+#include "XPMPMultiplayerVars.h"
+#include "XPMPPrefs.h"
+
+#include "XPLMGraphics.h"
+#include "XPLMDataAccess.h"
+#include "XPLMUtilities.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static const double kDegToRad = 3.14159265358979323846 / 180.0;
+
+// WGS84, which is what we try first.
+static const double kWGS84_A = 6378137.0;
+static const double kWGS84_E2 = 6.69437999014e-3;
+
+// If X-Plane has no earth radius dataref, this is what it uses for its sphere.
+static const double kDefaultEarthRadius = 6378145.0;
+
+// How far the calibration samples sit from the reference point.
+static const double kSampleDegrees = 0.01;
+static const double kSampleMeters = 1000.0;
+
+// A derived frame has to agree with XPLM to within this many meters at the validation point,
+// which sits about 80 km from the reference point.
+static const double kMaxFrameError = 1.0;
+
+// If the reference point moved by more than this, X-Plane has shifted its local origin.
+static const double kOriginShiftTolerance = 1.0;
+
+/*
+ * The sincos kernel below is a branch free port of the fdlibm one: round to the nearest
+ * quadrant, reduce by pi/2 in two parts, evaluate both polynomials on [-pi/4, pi/4] and pick
+ * the results by quadrant.  It's good to about one ulp over the range we need (+/- 2 pi).
+ *
+ */
+static inline void sincos_nobranch(double x, double * outSin, double * outCos)
+{
+	static const double kTwoOverPi = 6.36619772367581382433e-01;
+	static const double kPiO2_1 = 1.57079632673412561417e+00;	// first 33 bits of pi/2
+	static const double kPiO2_1T = 6.07710050650619224932e-11;	// pi/2 - kPiO2_1
+	static const double kRoundMagic = 6755399441055744.0;			// 1.5 * 2^52
+
+	static const double S1 = -1.66666666666666324348e-01;
+	static const double S2 =  8.33333333332248946124e-03;
+	static const double S3 = -1.98412698298579493134e-04;
+	static const double S4 =  2.75573137070700676789e-06;
+	static const double S5 = -2.50507602534068634195e-08;
+	static const double S6 =  1.58969099521155010221e-10;
+
+	static const double C1 =  4.16666666666666019037e-02;
+	static const double C2 = -1.38888888888741095749e-03;
+	static const double C3 =  2.48015872894767294178e-05;
+	static const double C4 = -2.75573143513906633035e-07;
+	static const double C5 =  2.08757232129817482790e-09;
+	static const double C6 = -1.13596475577881948265e-11;
+
+	// Adding the magic number rounds to the nearest integer without a float to int conversion.
+	// Doing it again on n / 4 gets us the quadrant, as d in -2..2 (2 and -2 both mean quadrant 2).
+	const double n = (x * kTwoOverPi + kRoundMagic) - kRoundMagic;
+	const double d = n - 4.0 * ((n * 0.25 + kRoundMagic) - kRoundMagic);
+	const bool odd = std::fabs(d) == 1.0;
+	const bool half = std::fabs(d) == 2.0;
+
+	const double r = (x - n * kPiO2_1) - n * kPiO2_1T;
+	const double z = r * r;
+	const double s = r + r * z * (S1 + z * (S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)))));
+	const double c = 1.0 - 0.5 * z + z * z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+
+	const double sinMag = odd ? c : s;
+	const double cosMag = odd ? s : c;
+	*outSin = (half || d == -1.0) ? -sinMag : sinMag;
+	*outCos = (half || d == 1.0) ? -cosMag : cosMag;
+}
+
+static void geodetic_to_ecef(double a, double e2, double lat, double lon, double elev, double ecef[3])
+{
+	const double sinLat = std::sin(lat * kDegToRad), cosLat = std::cos(lat * kDegToRad);
+	const double sinLon = std::sin(lon * kDegToRad), cosLon = std::cos(lon * kDegToRad);
+	const double N = a / std::sqrt(1.0 - e2 * sinLat * sinLat);
+	ecef[0] = (N + elev) * cosLat * cosLon;
+	ecef[1] = (N + elev) * cosLat * sinLon;
+	ecef[2] = (N * (1.0 - e2) + elev) * sinLat;
+}
+
+bool	LOCAL_SolveFrame(double a, double e2, const LocalFrameSample_t samples[4], LocalFrame_t * outFrame)
+{
+	outFrame->a = a;
+	outFrame->e2 = e2;
+	geodetic_to_ecef(a, e2, samples[0].lat, samples[0].lon, samples[0].elev, outFrame->ecef_origin);
+	outFrame->local_origin[0] = samples[0].x;
+	outFrame->local_origin[1] = samples[0].y;
+	outFrame->local_origin[2] = samples[0].z;
+
+	// D holds the ECEF offsets of the three samples as columns, L their local offsets.  We want
+	// M with M * D = L, so M = L * inverse(D).
+	double D[3][3], L[3][3];
+	for (int s = 0; s < 3; ++s)
+	{
+		double ecef[3];
+		const LocalFrameSample_t &sample = samples[s + 1];
+		geodetic_to_ecef(a, e2, sample.lat, sample.lon, sample.elev, ecef);
+		for (int r = 0; r < 3; ++r)
+			D[r][s] = ecef[r] - outFrame->ecef_origin[r];
+		L[0][s] = sample.x - samples[0].x;
+		L[1][s] = sample.y - samples[0].y;
+		L[2][s] = sample.z - samples[0].z;
+	}
+
+	const double det = D[0][0] * (D[1][1] * D[2][2] - D[1][2] * D[2][1])
+					 - D[0][1] * (D[1][0] * D[2][2] - D[1][2] * D[2][0])
+					 + D[0][2] * (D[1][0] * D[2][1] - D[1][1] * D[2][0]);
+	if (std::fabs(det) < 1e-6)
+		return false;
+
+	double inv[3][3];
+	inv[0][0] =  (D[1][1] * D[2][2] - D[1][2] * D[2][1]) / det;
+	inv[0][1] = -(D[0][1] * D[2][2] - D[0][2] * D[2][1]) / det;
+	inv[0][2] =  (D[0][1] * D[1][2] - D[0][2] * D[1][1]) / det;
+	inv[1][0] = -(D[1][0] * D[2][2] - D[1][2] * D[2][0]) / det;
+	inv[1][1] =  (D[0][0] * D[2][2] - D[0][2] * D[2][0]) / det;
+	inv[1][2] = -(D[0][0] * D[1][2] - D[0][2] * D[1][0]) / det;
+	inv[2][0] =  (D[1][0] * D[2][1] - D[1][1] * D[2][0]) / det;
+	inv[2][1] = -(D[0][0] * D[2][1] - D[0][1] * D[2][0]) / det;
+	inv[2][2] =  (D[0][0] * D[1][1] - D[0][1] * D[1][0]) / det;
+
+	for (int r = 0; r < 3; ++r)
+		for (int c = 0; c < 3; ++c)
+			outFrame->ecef_to_local[r * 3 + c] = L[r][0] * inv[0][c] + L[r][1] * inv[1][c] + L[r][2] * inv[2][c];
+	return true;
+}
+
+void	LOCAL_GeoToLocal(const LocalFrame_t * frame, std::size_t n,
+						 const double * __restrict lat, const double * __restrict lon, const double * __restrict elev,
+						 double * __restrict x, double * __restrict y, double * __restrict z)
+{
+	const double a = frame->a;
+	const double e2 = frame->e2;
+	// Everything the loop needs from the frame goes into locals, so the compiler doesn't
+	// have to worry about the outputs aliasing it.
+	double m[9];
+	for (int i = 0; i < 9; ++i) m[i] = frame->ecef_to_local[i];
+	const double ox = frame->ecef_origin[0], oy = frame->ecef_origin[1], oz = frame->ecef_origin[2];
+	const double lx = frame->local_origin[0], ly = frame->local_origin[1], lz = frame->local_origin[2];
+
+	for (std::size_t k = 0; k < n; ++k)
+	{
+		double sinLat, cosLat, sinLon, cosLon;
+		sincos_nobranch(lat[k] * kDegToRad, &sinLat, &cosLat);
+		sincos_nobranch(lon[k] * kDegToRad, &sinLon, &cosLon);
+
+		const double N = a / std::sqrt(1.0 - e2 * sinLat * sinLat);
+		const double h = elev[k];
+
+		// Subtract the origin before rotating - the ECEF values are millions of meters and we
+		// want to keep the precision for the small offsets.
+		const double ex = (N + h) * cosLat * cosLon - ox;
+		const double ey = (N + h) * cosLat * sinLon - oy;
+		const double ez = (N * (1.0 - e2) + h) * sinLat - oz;
+
+		x[k] = m[0] * ex + m[1] * ey + m[2] * ez + lx;
+		y[k] = m[3] * ex + m[4] * ey + m[5] * ez + ly;
+		z[k] = m[6] * ex + m[7] * ey + m[8] * ez + lz;
+	}
+}
+
+static LocalFrame_t		gFrame;
+static bool				gFrameValid = false;	// gFrame can be used for conversion
+static bool				gHaveReference = false;	// gRef is set - we probe it to detect origin shifts
+static LocalFrameSample_t	gRef;
+static double			gWorstVerifyError = 0.0;
+static unsigned			gFrameSerial = 0;		// Counts up every time the frame is rebuilt
+
+static bool try_earth_model(double a, double e2, const LocalFrameSample_t samples[4], const LocalFrameSample_t & check)
+{
+	LocalFrame_t frame;
+	if (!LOCAL_SolveFrame(a, e2, samples, &frame))
+		return false;
+
+	double x, y, z;
+	LOCAL_GeoToLocal(&frame, 1, &check.lat, &check.lon, &check.elev, &x, &y, &z);
+	const double err = std::sqrt((x - check.x) * (x - check.x) + (y - check.y) * (y - check.y) + (z - check.z) * (z - check.z));
+	if (err > kMaxFrameError)
+		return false;
+
+	gFrame = frame;
+	return true;
+}
+
+static void build_frame()
+{
+	LocalFrameSample_t samples[4];
+	XPLMLocalToWorld(0.0, 0.0, 0.0, &samples[0].lat, &samples[0].lon, &samples[0].elev);
+	samples[1] = samples[2] = samples[3] = samples[0];
+	samples[1].lat += kSampleDegrees;
+	samples[2].lon += kSampleDegrees;
+	samples[3].elev += kSampleMeters;
+	for (LocalFrameSample_t &s : samples)
+		XPLMWorldToLocal(s.lat, s.lon, s.elev, &s.x, &s.y, &s.z);
+
+	LocalFrameSample_t check = samples[0];
+	check.lat += 0.5;
+	check.lon += 0.5;
+	check.elev += 3000.0;
+	XPLMWorldToLocal(check.lat, check.lon, check.elev, &check.x, &check.y, &check.z);
+
+	gRef = samples[0];
+	gHaveReference = true;
+	++gFrameSerial;
+
+	XPLMDataRef earthRadiusRef = XPLMFindDataRef("sim/physics/earth_radius_m");
+	const double earthRadius = earthRadiusRef ? XPLMGetDataf(earthRadiusRef) : kDefaultEarthRadius;
+
+	gFrameValid = try_earth_model(kWGS84_A, kWGS84_E2, samples, check) ||
+				  try_earth_model(earthRadius > 0.0 ? earthRadius : kDefaultEarthRadius, 0.0, samples, check);
+	if (!gFrameValid)
+		XPLMDebugString("libxplanemp: could not derive the local coordinate frame, using XPLMWorldToLocal for every plane.\n");
+}
+
+void	LOCAL_UpdateFrame()
+{
+	if (gHaveReference)
+	{
+		double x, y, z;
+		XPLMWorldToLocal(gRef.lat, gRef.lon, gRef.elev, &x, &y, &z);
+		const double dx = x - gRef.x, dy = y - gRef.y, dz = z - gRef.z;
+		if (dx * dx + dy * dy + dz * dz <= kOriginShiftTolerance * kOriginShiftTolerance)
+			return;
+	}
+	build_frame();
+}
+
+unsigned	LOCAL_FrameSerial()
+{
+	return gFrameSerial;
+}
+
+void	LOCAL_Convert(LocalBatch_t & batch)
+{
+	const std::size_t n = batch.size();
+	batch.x.resize(n);
+	batch.y.resize(n);
+	batch.z.resize(n);
+
+	if (!gFrameValid)
+	{
+		for (std::size_t k = 0; k < n; ++k)
+			XPLMWorldToLocal(batch.lat[k], batch.lon[k], batch.elev[k], &batch.x[k], &batch.y[k], &batch.z[k]);
+		return;
+	}
+
+	LOCAL_GeoToLocal(&gFrame, n, batch.lat.data(), batch.lon.data(), batch.elev.data(),
+					 batch.x.data(), batch.y.data(), batch.z.data());
+
+	if (gPrefs.debugLocalConversion)
+	{
+		double worst = 0.0;
+		for (std::size_t k = 0; k < n; ++k)
+		{
+			double x, y, z;
+			XPLMWorldToLocal(batch.lat[k], batch.lon[k], batch.elev[k], &x, &y, &z);
+			const double dx = x - batch.x[k], dy = y - batch.y[k], dz = z - batch.z[k];
+			worst = std::max(worst, std::sqrt(dx * dx + dy * dy + dz * dz));
+		}
+		if (worst > gWorstVerifyError)
+		{
+			gWorstVerifyError = worst;
+			char buf[256];
+			sprintf(buf, "libxplanemp: new worst local conversion error %f m over %zu planes.\n", worst, n);
+			XPLMDebugString(buf);
+		}
+	}
+}
@@ -0,0 +1,104 @@
+#ifndef XPMPLOCALFRAME_H
+#define XPMPLOCALFRAME_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * XPMPLocalFrame
+ *
+ * Converts lat/lon/elevation into X-Plane's local OpenGL coordinates without calling into
+ * the sim for every plane.  X-Plane's local frame is an earth centered (ECEF) frame that has
+ * been rotated and moved so the reference point sits near the origin with Y up - an affine
+ * transform.  We recover that transform once by asking XPLMWorldToLocal about four points,
+ * and from then on convert whole batches of planes ourselves.
+ *
+ * When X-Plane moves its reference point, the frame is rebuilt.  We notice that by probing
+ * one known point per frame.  If the derived frame ever fails validation against XPLM (a sim
+ * with a different earth model), we quietly fall back to calling XPLMWorldToLocal per plane.
+ *
+ * The LOCAL_SolveFrame and LOCAL_GeoToLocal routines are pure math and don't touch the SDK.
+ *
+ */
+
+struct LocalFrame_t {
+	double	a;						// Earth model: semi major axis in meters
+	double	e2;						// Earth model: first eccentricity squared (0 for a sphere)
+	double	ecef_origin[3];			// ECEF position of the reference point
+	double	local_origin[3];		// Local position of the reference point
+	double	ecef_to_local[9];		// Row major 3x3, applied to (ecef - ecef_origin)
+};
+
+// One correspondence between a geodetic position and X-Plane's answer for it.
+struct LocalFrameSample_t {
+	double	lat;					// degrees
+	double	lon;					// degrees
+	double	elev;					// meters
+	double	x;
+	double	y;
+	double	z;
+};
+
+// A batch of positions to convert, as a structure of arrays.
+struct LocalBatch_t {
+	std::vector<double>	lat;		// degrees
+	std::vector<double>	lon;		// degrees
+	std::vector<double>	elev;		// meters
+	std::vector<double>	x;			// outputs, filled by LOCAL_Convert
+	std::vector<double>	y;
+	std::vector<double>	z;
+
+	void clear() { lat.clear(); lon.clear(); elev.clear(); }
+	void push(double inLat, double inLon, double inElev) { lat.push_back(inLat); lon.push_back(inLon); elev.push_back(inElev); }
+	std::size_t size() const { return lat.size(); }
+};
+
+/*
+ * LOCAL_SolveFrame
+ *
+ * Derives the frame from four samples: sample 0 is the reference point, the other three must
+ * be offset from it in independent directions (north, east and up work well).  Returns false
+ * if the samples are degenerate.
+ *
+ */
+bool	LOCAL_SolveFrame(double a, double e2, const LocalFrameSample_t samples[4], LocalFrame_t * outFrame);
+
+/*
+ * LOCAL_GeoToLocal
+ *
+ * The conversion kernel.  Branch free, so the compiler can vectorize it.
+ *
+ */
+void	LOCAL_GeoToLocal(const LocalFrame_t * frame, std::size_t n,
+						 const double * __restrict lat, const double * __restrict lon, const double * __restrict elev,
+						 double * __restrict x, double * __restrict y, double * __restrict z);
+
+/*
+ * LOCAL_UpdateFrame
+ *
+ * Call once per frame before converting.  Builds the frame the first time and rebuilds it when
+ * X-Plane has shifted its local origin.
+ *
+ */
+void	LOCAL_UpdateFrame();
+
+/*
+ * LOCAL_FrameSerial
+ *
+ * Counts up every time LOCAL_UpdateFrame rebuilds the frame, and is 0 before the first time.
+ * Local coordinates converted under one serial are stale once it changes.
+ *
+ */
+unsigned	LOCAL_FrameSerial();
+
+/*
+ * LOCAL_Convert
+ *
+ * Converts a whole batch into local coordinates, either with our own frame or - if we don't
+ * have a valid one - with XPLMWorldToLocal.  With the debug:local_conversion pref set, every
+ * result is checked against XPLM and the worst error is logged.
+ *
+ */
+void	LOCAL_Convert(LocalBatch_t & batch);
+
+#endif
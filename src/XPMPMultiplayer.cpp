@@ -23,8 +23,10 @@
 
 #include "XPMPMultiplayer.h"
 #include "XPMPMultiplayerVars.h"
+#include "XPMPPrefs.h"
 #include "XPMPPlaneRenderer.h"
 #include "XPMPMultiplayerCSL.h"
+#include "XPMPSpatialIndex.h"
 #include "XPLMUtilities.h"
 
 #include <algorithm>
@@ -218,6 +220,7 @@ const char * 	XPMPMultiplayerInitLegacyData(
 	gDefaultPlane = inDefaultPlane;
 	gIntPrefsFunc = inIntPrefsFunc;
 	gFloatPrefsFunc = inFloatPrefsFunc;
+	PREFS_Refresh();
 
 	// Set up OpenGL for our drawing callbacks
 	OGL_UtilsInit();
@@ -293,6 +296,7 @@ const char * 	XPMPMultiplayerInit(int (* inIntPrefsFunc)(const char *, const cha
 {
 	gIntPrefsFunc = inIntPrefsFunc;
 	gFloatPrefsFunc = inFloatPrefsFunc;
+	PREFS_Refresh();
 	//char	myPath[1024];
 	//char	airPath[1024];
 	//char	line[256];
@@ -304,6 +308,11 @@ const char * 	XPMPMultiplayerInit(int (* inIntPrefsFunc)(const char *, const cha
 	return "";
 }
 
+void XPMPRefreshPrefs(void)
+{
+	PREFS_Refresh();
+}
+
 void XPMPMultiplayerCleanup(void)
 {
 	XPMPDeinitDefaultPlaneRenderer();
@@ -367,7 +376,7 @@ const  char * XPMPMultiplayerEnable(void)
 
 		XPLMCountAircraft(&total, &active, &who);
 
-		if (gIntPrefsFunc("debug", "tcas_traffic", 1))
+		if (gPrefs.debugTcasTraffic)
 		{
 			// Register the plane control calls.
 			XPLMRegisterDrawCallback(XPMPDisablePlaneCount, xplm_Phase_Airplanes, 1 /* before */, nullptr);
@@ -393,6 +402,7 @@ const  char * XPMPMultiplayerEnable(void)
 							 xplm_Phase_Window, 1 /* before */, nullptr /* refcon */);
 
 	XPLMRegisterFlightLoopCallback(ThreadSynchronizer::flightLoopCallback, -1, &gThreadSynchronizer);
+	XPLMRegisterFlightLoopCallback(XPMPDefaultPlaneRendererFlightLoop, -1, nullptr);
 
 	if (result == 0)
 	{
@@ -407,7 +417,7 @@ void XPMPMultiplayerDisable(void)
 		XPLMReleasePlanes();
 		gHasControlOfAIAircraft = false;
 
-		if (gIntPrefsFunc("debug", "tcas_traffic", 1))
+		if (gPrefs.debugTcasTraffic)
 		{
 			XPLMUnregisterDrawCallback(XPMPDisablePlaneCount, xplm_Phase_Gauges, 0, nullptr);
 			XPLMUnregisterDrawCallback(XPMPEnablePlaneCount, xplm_Phase_Gauges, 1, nullptr);
@@ -419,6 +429,7 @@ void XPMPMultiplayerDisable(void)
 	XPLMUnregisterDrawCallback(XPMPRenderMultiplayerPlanes, xplm_Phase_Airplanes, 0, nullptr);
 	XPLMUnregisterDrawCallback(XPMPRenderPlaneLabels, xplm_Phase_Window, 1, nullptr);
 	XPLMUnregisterFlightLoopCallback(ThreadSynchronizer::flightLoopCallback, &gThreadSynchronizer);
+	XPLMUnregisterFlightLoopCallback(XPMPDefaultPlaneRendererFlightLoop, nullptr);
 }
 
 
@@ -528,6 +539,7 @@ XPMPPlaneID		XPMPCreatePlane(
 	gPlanes.push_back(plane);
 	
 	XPMPPlanePtr planePtr = gPlanes.back().get();
+	SPATIAL_Insert(planePtr);
 	for (XPMPPlaneNotifierVector::iterator iter = gObservers.begin(); iter !=
 		 gObservers.end(); ++iter)
 	{
@@ -595,6 +607,7 @@ XPMPPlaneID     XPMPCreatePlaneWithModelName(const char *inModelName, const char
 	gPlanes.push_back(plane);
 
 	XPMPPlanePtr planePtr = gPlanes.back().get();
+	SPATIAL_Insert(planePtr);
 	for (XPMPPlaneNotifierVector::iterator iter = gObservers.begin(); iter !=
 		 gObservers.end(); ++iter)
 	{
@@ -643,6 +656,8 @@ void			XPMPDestroyPlane(XPMPPlaneID inID)
 	{
 		iter2->first.first(plane, xpmp_PlaneNotification_Destroyed, iter2->first.second);
 	}
+	SPATIAL_Remove(plane);
+	XPMPDefaultPlaneRendererForgetPlane(plane);
 	gPlanes.erase(iter);
 }
 
@@ -672,6 +687,14 @@ int	XPMPChangePlaneModel(
 	return plane->match_quality;
 }	
 
+void	XPMPSetPlaneLabelPriority(
+		XPMPPlaneID				inPlaneID,
+		int						inPriority)
+{
+	XPMPPlanePtr plane = XPMPPlaneFromID(inPlaneID);
+	plane->labelPriority = inPriority;
+}
+
 void	XPMPSetDefaultPlaneICAO(
 		const char *			inICAO)
 {
@@ -739,9 +762,17 @@ XPMPPlaneCallbackResult			XPMPGetPlaneData(
 	{
 		if (plane->posAge != now)
 		{
+			const XPMPPlanePosition_t old = plane->pos;
 			result = plane->dataFunc(plane, inDataType, &plane->pos, plane->ref);
 			if (result == xpmpData_NewData)
+			{
 				plane->posAge = now;
+				if (memcmp(&old, &plane->pos, sizeof(old)) != 0)
+				{
+					plane->posChanged = now;
+					SPATIAL_Update(plane);
+				}
+			}
 		}
 
 		XPMPPlanePosition_t *	posD = (XPMPPlanePosition_t *) outData;
@@ -754,9 +785,14 @@ XPMPPlaneCallbackResult			XPMPGetPlaneData(
 	{
 		if (plane->surfaceAge != now)
 		{
+			const XPMPPlaneSurfaces_t old = plane->surface;
 			result = plane->dataFunc(plane, inDataType, &plane->surface, plane->ref);
 			if (result == xpmpData_NewData)
+			{
 				plane->surfaceAge = now;
+				if (memcmp(&old, &plane->surface, sizeof(old)) != 0)
+					plane->surfaceChanged = now;
+			}
 		}
 
 		XPMPPlaneSurfaces_t *	surfD = (XPMPPlaneSurfaces_t *) outData;
@@ -854,8 +890,10 @@ int	XPMPRenderMultiplayerPlanes(
 
 	if (gRenderer)
 		gRenderer(is_shadow ? 0 : is_blend,gRendererRef);
+	else if (is_shadow)
+		XPMPDefaultShadowRenderer();
 	else
-		XPMPDefaultPlaneRenderer(is_shadow ? 0 : is_blend);
+		XPMPDefaultPlaneRenderer(is_blend);
 	if(!is_shadow)
 		is_blend = 1 - is_blend;
 	return 1;
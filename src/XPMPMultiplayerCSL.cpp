@@ -24,6 +24,8 @@
 #include "XPMPMultiplayerCSL.h"
 #include "XPLMUtilities.h"
 #include "XPMPMultiplayerObj.h"
+#include "XPMPPrefs.h"
+#include "XPMPTransforms.h"
 #include "XStringUtils.h"
 #include "XOGLUtils.h"
 #include "XUtils.h"
@@ -543,6 +545,7 @@ bool ParseObj8Command(const std::vector<std::string> &tokens, CSLPackage_t &pack
 	obj_for_acf		att;
 
 	att.load_state = load_none;
+	att.needs_animation = true;
 
 	if(tokens[1] == "GLASS")
 		att.draw_type = draw_glass;
@@ -893,7 +896,7 @@ bool CSL_LoadCSL(const char * inFolderPath, const char * inRelatedFile, const ch
 	// read the list of aircraft codes
 	FILE * aircraft_fi = fopen(inDoc8643, "r");
 
-	if (gIntPrefsFunc("debug", "model_matching", 0))
+	if (gPrefs.debugModelMatching)
 		XPLMDebugString(std::string(std::string(inDoc8643) + " returned " + (aircraft_fi ? "valid" : "invalid") + " fp\n").c_str());
 
 	if (aircraft_fi)
@@ -905,7 +908,7 @@ bool CSL_LoadCSL(const char * inFolderPath, const char * inRelatedFile, const ch
 			BreakStringPvt(buf, tokens, 0, "\t\r\n");
 
 			/*
-			if (gIntPrefsFunc("debug", "model_matching", 0)) {
+			if (gPrefs.debugModelMatching) {
 				char str[20];
 				sprintf(str, "size: %i", tokens.size());
 				string s = string(str) + string(": ") + buf;
@@ -924,7 +927,7 @@ bool CSL_LoadCSL(const char * inFolderPath, const char * inRelatedFile, const ch
 
 			// Debugging stuff
 			/*
-			if (gIntPrefsFunc("debug", "model_matching", 0)) {
+			if (gPrefs.debugModelMatching) {
 				XPLMDebugString("Loaded entry: icao code ");
 				XPLMDebugString(entry.icao.c_str());
 				XPLMDebugString(" equipment ");
@@ -1099,7 +1102,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 
 	char	buf[4096];
 
-	if (gIntPrefsFunc("debug", "model_matching", 0))
+	if (gPrefs.debugModelMatching)
 	{
 		sprintf(buf, XPMP_CLIENT_NAME " MATCH - ICAO=%s AIRLINE=%s LIVERY=%s GROUP=%s\n", icao.c_str(), airline.c_str(), livery.c_str(), group.c_str());
 		XPLMDebugString(buf);
@@ -1111,7 +1114,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 		// Build up the right key for this pass.
 		key = kUseICAO[n] ? icao : group;
 		if (!kUseICAO[n] && group == "") {
-			if (gIntPrefsFunc("debug", "model_matching", 0)) {
+			if (gPrefs.debugModelMatching) {
 				sprintf(buf, XPMP_CLIENT_NAME " MATCH -    Skipping %d Due nil Group\n", n);
 				XPLMDebugString(buf);
 			}
@@ -1120,7 +1123,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 
 		if (kUseAirline[n]) {
 			if (airline == "") {
-				if (gIntPrefsFunc("debug", "model_matching", 0)) {
+				if (gPrefs.debugModelMatching) {
 					sprintf(buf, XPMP_CLIENT_NAME " MATCH -    Skipping %d Due Absent Airline\n", n);
 					XPLMDebugString(buf);
 				}
@@ -1132,7 +1135,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 		
 		if (kUseLivery[n]) {
 			if (livery == "") {
-				if (gIntPrefsFunc("debug", "model_matching", 0)) {
+				if (gPrefs.debugModelMatching) {
 					sprintf(buf, XPMP_CLIENT_NAME " MATCH -    Skipping %d Due Absent Livery\n", n);
 					XPLMDebugString(buf);
 				}
@@ -1142,7 +1145,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 			key += livery;
 		}
 
-		if (gIntPrefsFunc("debug", "model_matching", 0))
+		if (gPrefs.debugModelMatching)
 		{
 			sprintf(buf, XPMP_CLIENT_NAME " MATCH -    Group %d key %s\n", n, key.c_str());
 			XPLMDebugString(buf);
@@ -1160,7 +1163,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 					{
 						if (nullptr != match_quality) *match_quality = n;
 
-						if (gIntPrefsFunc("debug", "model_matching", 0)) {
+						if (gPrefs.debugModelMatching) {
 							sprintf(buf, XPMP_CLIENT_NAME " MATCH - Found: %s/%s/%s : %s - %s\n", 
 								gPackages[p].planes[iter->second].icao.c_str(),
 								gPackages[p].planes[iter->second].airline.c_str(),
@@ -1175,7 +1178,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 		}
 	}
 
-	if (gIntPrefsFunc("debug", "model_matching", 0))
+	if (gPrefs.debugModelMatching)
 	{
 		XPLMDebugString(XPMP_CLIENT_NAME " MATCH - No match.\n");
 	}
@@ -1190,7 +1193,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 	std::map<std::string, CSLAircraftCode_t>::const_iterator model_it = gAircraftCodes.find(icao);
 	if(model_it != gAircraftCodes.end()) {
 
-		if (gIntPrefsFunc("debug", "model_matching", 0))
+		if (gPrefs.debugModelMatching)
 		{
 			XPLMDebugString(XPMP_CLIENT_NAME " MATCH/acf - Looking for a ");
 			switch(model_it->second.category) {
@@ -1210,7 +1213,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 		// 5. match WTC
 		for(int pass = 1; pass <= 5; ++pass) {
 
-			if (gIntPrefsFunc("debug", "model_matching", 0))
+			if (gPrefs.debugModelMatching)
 			{
 				switch(pass) {
 				case 1: XPLMDebugString(XPMP_CLIENT_NAME " Match/acf - matching WTC and configuration\n"); break;
@@ -1254,7 +1257,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 
 								if(match) {
 									// bingo
-									if (gIntPrefsFunc("debug", "model_matching", 0))
+									if (gPrefs.debugModelMatching)
 									{
 										XPLMDebugString(XPMP_CLIENT_NAME " MATCH/acf - found: ");
 										XPLMDebugString(it->first.c_str());
@@ -1272,7 +1275,7 @@ CSLPlane_t *	CSL_MatchPlane(const char * inICAO, const char * inAirline, const c
 		}
 	}
 
-	if (gIntPrefsFunc("debug", "model_matching", 0)) {
+	if (gPrefs.debugModelMatching) {
 		XPLMDebugString(std::string("gAircraftCodes.find(" + icao + ") returned no match.\n").c_str());
 	}
 
@@ -1333,19 +1336,27 @@ void			CSL_DrawObject(
 		double 					roll,
 		double 					heading,
 		int						type,
-		int	   					full,
+		int	   					lod,
 		xpmp_LightStatus		lights,
-		XPLMPlaneDrawState_t *	state)
+		XPLMPlaneDrawState_t *	state,
+		const float *			modelMatrix,
+		const FrameContext_t &	context)
 {
-	// Setup OpenGL for this plane render
-	if(type != plane_Obj8 && type != plane_Obj8_Transparent)
+	float ownMatrix[16];
+	if (!modelMatrix && type != plane_Obj8 && type != plane_Obj8_Transparent && type != plane_Obj8_Shadow)
+	{
+		XFORM_ModelMatrix(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z),
+						  static_cast<float>(pitch), static_cast<float>(roll), static_cast<float>(heading), ownMatrix);
+		modelMatrix = ownMatrix;
+	}
+
+	// Setup OpenGL for this plane render.  OBJ8s and lights place themselves.
+	const bool pushMatrix = (type == plane_Austin || type == plane_Obj);
+	if(pushMatrix)
 	{
 		glMatrixMode(GL_MODELVIEW);
 		glPushMatrix();
-		glTranslatef(static_cast<GLfloat>(x), static_cast<GLfloat>(y), static_cast<GLfloat>(z));
-		glRotatef(static_cast<GLfloat>(heading), 0.0, -1.0, 0.0);
-		glRotatef(static_cast<GLfloat>(pitch), 01.0, 0.0, 0.0);
-		glRotatef(static_cast<GLfloat>(roll), 0.0, 0.0, -1.0);
+		glMultMatrixf(modelMatrix);
 	}
 
 	CSLPlane_t *model = plane->model;
@@ -1361,27 +1372,30 @@ void			CSL_DrawObject(
 			XPLMDrawAircraft(model->austin_idx,
 							 static_cast<GLfloat>(x), static_cast<GLfloat>(y), static_cast<GLfloat>(z),
 							 static_cast<GLfloat>(pitch), static_cast<GLfloat>(roll), static_cast<GLfloat>(heading),
-							 full, state);
+							 lod == lod_Full ? 1 : 0, state);
 	}
 		break;
 	case plane_Obj:
-		OBJ_PlotModel(plane, full ? distance : max(distance, 10000.0f),
-					  x, y ,z, pitch, roll, heading);
+		OBJ_PlotModel(plane, lod == lod_Full ? distance : max(distance, 10000.0f),
+					  x, y ,z, pitch, roll, heading, context);
 		break;
 	case plane_Lights:
-		OBJ_DrawLights(plane, distance,
-					   x, y ,z, pitch, roll, heading, lights);
+		OBJ_DrawLights(plane, distance, modelMatrix, lights);
 		break;
 
 	case plane_Obj8:
-		OBJ8_DrawModel(plane, x, y, z, pitch, roll, heading, lights, state, false);
+		OBJ8_DrawModel(plane, x, y, z, pitch, roll, heading, lights, state, false, lod, context);
 		break;
 
 	case plane_Obj8_Transparent:
-		OBJ8_DrawModel(plane, x, y, z, pitch, roll, heading, lights, state, true);
+		OBJ8_DrawModel(plane, x, y, z, pitch, roll, heading, lights, state, true, lod, context);
+		break;
+
+	case plane_Obj8_Shadow:
+		OBJ8_DrawShadowModel(plane, x, y, z, pitch, roll, heading, state, context);
 		break;
 	}
 
-	if(type != plane_Obj8 && type != plane_Obj8_Transparent)
+	if(pushMatrix)
 		glPopMatrix();
 }
@@ -35,6 +35,8 @@
 #include "XPLMPlanes.h"
 #include "XPMPMultiplayerVars.h"
 
+struct FrameContext_t;
+
 /*
  * CSL_Init
  *
@@ -100,7 +102,9 @@ int				CSL_GetOGLIndex(CSLPlane_t *		model);
  * CSL_DrawObject
  *
  * Given a plane model rep and the params, this routine does the real drawing.  The coordinate system must be pre-shifted
- * to the plane's location.  (This just dispatches to the appropriate drawing method).
+ * to the plane's location.  (This just dispatches to the appropriate drawing method).  lod is one of the lod_ values.
+ * modelMatrix is the plane's model matrix from XFORM_ModelMatrices, or nullptr to build one from the position.
+ * context is the current frame's, see XPMPFrameContext.
  *
  */
 void			CSL_DrawObject(
@@ -113,9 +117,11 @@ void			CSL_DrawObject(
 		double 					roll,
 		double 					heading,
 		int						type,
-		int	   					full,
+		int	   					lod,
 		xpmp_LightStatus		lights,
-		XPLMPlaneDrawState_t *	state);
+		XPLMPlaneDrawState_t *	state,
+		const float *			modelMatrix,
+		const FrameContext_t &	context);
 
 
 #if APL
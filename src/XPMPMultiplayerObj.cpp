@@ -25,6 +25,9 @@
 
 #include "XPMPMultiplayerObj.h"
 #include "XPMPMultiplayerVars.h"
+#include "XPMPPrefs.h"
+#include "XPMPFrameContext.h"
+#include "XPMPAllocations.h"
 
 //#include "PlatformUtils.h"
 #include "XObjReadWrite.h"
@@ -71,6 +74,30 @@ const	float	kTaxiLight[] = {1.0f, 1.0f, 0.7f, 0.6f};
 
 static	int sLightTexture = -1;
 
+// Works out what a light is from its magic color, and what color it really has.
+static void classify_light(LightInfo_t &light)
+{
+	static const LightType kMagicTypes[] = { light_NavRed, light_NavGreen, light_Beacon, light_Strobe, light_Landing, light_Taxi };
+	static const float * const kMagicColors[] = { kNavLightRed, kNavLightGreen, kNavLightRed, kStrobeLight, kLandingLight, kTaxiLight };
+
+	const int * rgb = light.rgb;
+	light.type = light_Other;
+	if (rgb[0] == rgb[1] && rgb[1] == rgb[2] && rgb[0] % 11 == 0 && rgb[0] >= 11 && rgb[0] <= 66)
+		light.type = kMagicTypes[rgb[0] / 11 - 1];
+
+	if (light.type == light_Other)
+	{
+		for (int c = 0; c < 3; ++c)
+			light.color[c] = static_cast<float>(rgb[c]) * 0.1f;
+		light.color[3] = 1.0f;
+	}
+	else
+	{
+		const float * color = kMagicColors[light.type];
+		std::copy(color, color + 4, light.color);
+	}
+}
+
 static void MakePartialPathNativeObj(std::string& io_str)
 {
 	//	char sep = *XPLMGetDirectorySeparator();
@@ -79,8 +106,35 @@ static void MakePartialPathNativeObj(std::string& io_str)
 			io_str[i] = '/';
 }
 
-static	XPLMDataRef sFOVRef = XPLMFindDataRef("sim/graphics/view/field_of_view_deg");
 static	float		sFOV = 60.0;
+static	float		sElapsed = 0.0f;			// Sim time for the flash patterns, as of OBJ_BeginLightDrawing
+static	XPLMCameraPosition_t	sCameraPos;			// Where we are looking, as of OBJ_BeginLightDrawing
+static	float		sCameraRight[3];			// The camera's axes in local coordinates, for billboarding lights
+static	float		sCameraUp[3];
+
+struct LightVertex_t {
+	float		xyz[3];
+	float		st[2];
+	float		rgba[4];
+};
+static	std::vector<LightVertex_t>	sLightVertices;		// Quads of all the lights since OBJ_BeginLightDrawing
+
+struct LitLight_t {
+	float		center[3];
+	float		half;			// Half the billboard's size
+	float		st[2];			// Where its quarter of the texture starts
+	float		rgba[4];
+};
+static	std::vector<LitLight_t>		sLitLights;			// Scratch - the lights of one plane that are on
+
+// The corners of a light billboard in GL_QUADS order: signs along the camera's right and up axes,
+// then offsets into the light's quarter of the texture.
+static	const float		kLightCorners[4][4] = {
+	{ -1.0f, -1.0f, 0.0f,  0.0f },
+	{ -1.0f,  1.0f, 0.0f,  0.5f },
+	{  1.0f,  1.0f, 0.25f, 0.5f },
+	{  1.0f, -1.0f, 0.25f, 0.0f }
+};
 
 bool 	NormalizeVec(float vec[3])
 {
@@ -257,7 +311,7 @@ int OBJ_LoadLightTexture(const std::string &inFilePath, bool inForceMaxTex)
 	if (sTexes.count(path) > 0)
 		return sTexes[path];
 
-	int derez = 5 - gIntPrefsFunc("planes", "resolution", 5);
+	int derez = 5 - gPrefs.resolution;
 	if (inForceMaxTex)
 		derez = 0;
 
@@ -299,7 +353,7 @@ TextureManager::ResourceHandle OBJ_LoadTexture(const std::string &path)
 		XPLMDebugString(")\n");
 #endif
 
-	int derez = 5 - gIntPrefsFunc("planes", "resolution", 5);
+	int derez = 5 - gPrefs.resolution;
 	ImageInfo im;
 	CSLTexture_t texture;
 	texture.id = 0;
@@ -437,6 +491,7 @@ ObjManager::ResourceHandle OBJ_LoadModel(const std::string &inFilePath)
 					objInfo.lods.back().lights.back().rgb[0] = static_cast<int>(cmd.rgb[n].rgb[0]);
 					objInfo.lods.back().lights.back().rgb[1] = static_cast<int>(cmd.rgb[n].rgb[1]);
 					objInfo.lods.back().lights.back().rgb[2] = static_cast<int>(cmd.rgb[n].rgb[2]);
+					classify_light(objInfo.lods.back().lights.back());
 				}
 			}
 			break;
@@ -621,7 +676,7 @@ void OBJ_MaintainTextures() {
 // in if the user wants to override the default texture specified by the
 // obj file
 void	OBJ_PlotModel(XPMPPlane_t *plane, float inDistance, double /*inX*/,
-					  double /*inY*/, double /*inZ*/, double /*inPitch*/, double /*inRoll*/, double /*inHeading*/)
+					  double /*inY*/, double /*inZ*/, double /*inPitch*/, double /*inRoll*/, double /*inHeading*/, const FrameContext_t & inContext)
 {
 	auto objHandle = std::atomic_load(&plane->objHandle);
 	if (! objHandle || objHandle->loadStatus == Failed) { return; }
@@ -676,8 +731,7 @@ void	OBJ_PlotModel(XPMPPlane_t *plane, float inDistance, double /*inX*/,
 	if(obj->lods[lodIdx].pointPool.Size()==0 && obj->lods[lodIdx].dl == 0)
 		return;
 
-	static XPLMDataRef	night_lighting_ref = XPLMFindDataRef("sim/graphics/scenery/percent_lights_on");
-	bool use_night = plane->useNightTexture < 0 ? XPLMGetDataf(night_lighting_ref) > 0.25f : static_cast<bool>(plane->useNightTexture);
+	bool use_night = plane->useNightTexture < 0 ? inContext.night : static_cast<bool>(plane->useNightTexture);
 
 	int tex = 0;
 	int lit = 0;
@@ -695,12 +749,13 @@ void	OBJ_PlotModel(XPMPPlane_t *plane, float inDistance, double /*inX*/,
 
 	if (!use_night)	lit = 0;
 	if (tex == 0) lit = 0;
-	XPLMSetGraphicsState(1, (tex != 0) + (lit != 0), 1, 1, 1, 1, 1);
-	if (tex != 0)	XPLMBindTexture2d(tex, 0);
-	if (lit != 0)	XPLMBindTexture2d(lit, 1);
+	// The renderer sorts OBJ7 planes by texture, so most of these are already set.
+	OGL_SetGraphicsState(1, (tex != 0) + (lit != 0), 1, 1, 1, 1, 1);
+	if (tex != 0)	OGL_BindTexture2d(tex, 0);
+	if (lit != 0)	OGL_BindTexture2d(lit, 1);
 
-	if (tex) { glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE); }
-	if (lit) { glActiveTextureARB(GL_TEXTURE1); glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_ADD); glActiveTextureARB(GL_TEXTURE0); }
+	if (tex) { OGL_SetTexEnvMode(0, GL_MODULATE); }
+	if (lit) { OGL_SetTexEnvMode(1, GL_ADD); }
 
 	if (obj->lods[lodIdx].dl == 0)
 	{
@@ -777,17 +832,27 @@ void	OBJ_PlotModel(XPMPPlane_t *plane, float inDistance, double /*inX*/,
  RGB of 55,55,55 is a landing light
  RGB of 66,66,66 is a taxi light
 ******************************************************/
-void	OBJ_BeginLightDrawing()
+void	OBJ_BeginLightDrawing(const FrameContext_t & inContext)
 {
-	sFOV = XPLMGetDataf(sFOVRef);
+	sFOV = inContext.fov;
+	sElapsed = inContext.elapsed;
+	sCameraPos = inContext.camera;
+	const float * modelView = inContext.view.model_view;
+
+	// The rows of the model view's rotation are the camera's axes.
+	for (int n = 0; n < 3; ++n)
+	{
+		sCameraRight[n] = modelView[n * 4];
+		sCameraUp[n] = modelView[n * 4 + 1];
+	}
 
 	// Setup OpenGL for the drawing
-	XPLMSetGraphicsState(1, 1, 0,   1, 1 ,   1, 0);
-	XPLMBindTexture2d(sLightTexture, 0);
+	OGL_SetGraphicsState(1, 1, 0,   1, 1 ,   1, 0);
+	OGL_BindTexture2d(sLightTexture, 0);
+	sLightVertices.clear();
 }
 
-void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, double inX, double inY,
-					   double inZ, double inPitch, double inRoll, double inHeading,
+void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, const float * inModelMatrix,
 					   xpmp_LightStatus lights)
 {
 	bool navLights = lights.navLights == 1;
@@ -804,7 +869,7 @@ void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, double inX, double inY
 	// flash frequencies
 	if(bcnLights) {
 		bcnLights = false;
-		int x = (int)(XPLMGetElapsedTime() * 1000 + offset) % 1200;
+		int x = (int)(sElapsed * 1000 + offset) % 1200;
 		switch(lights.flashPattern) {
 		case xpmp_Lights_Pattern_EADS:
 			// EADS pattern: two flashes every 1.2 seconds
@@ -813,7 +878,7 @@ void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, double inX, double inY
 
 		case xpmp_Lights_Pattern_GA:
 			// GA pattern: 900ms / 1200ms
-			if((((int)(XPLMGetElapsedTime() * 1000 + offset) % 2100) < 900)) bcnLights = true;
+			if((((int)(sElapsed * 1000 + offset) % 2100) < 900)) bcnLights = true;
 			break;
 
 		case xpmp_Lights_Pattern_Default:
@@ -826,7 +891,7 @@ void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, double inX, double inY
 	}
 	if(strbLights) {
 		strbLights = false;
-		int x = (int)(XPLMGetElapsedTime() * 1000 + offset) % 1700;
+		int x = (int)(sElapsed * 1000 + offset) % 1700;
 		switch(lights.flashPattern) {
 		case xpmp_Lights_Pattern_EADS:
 			if(x < 80 || (x > 260 && x < 340)) strbLights = true;
@@ -834,7 +899,7 @@ void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, double inX, double inY
 
 		case xpmp_Lights_Pattern_GA:
 			// similar to the others.. but a little different frequency :)
-			x = (int)(XPLMGetElapsedTime() * 1000 + offset) % 1900;
+			x = (int)(sElapsed * 1000 + offset) % 1900;
 			if(x < 100) strbLights = true;
 			break;
 
@@ -860,178 +925,140 @@ void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, double inX, double inY
 	if(lodIdx == -1)
 		return;
 
+	// Find our distance from the camera - the same for all the lights.
+	const float * m = inModelMatrix;
+	float dx = sCameraPos.x - m[12];
+	float dy = sCameraPos.y - m[13];
+	float dz = sCameraPos.z - m[14];
+	double distance = sqrt((dx * dx) + (dy * dy) + (dz * dz));
+
+	// Convert to NM
+	distance *= kMetersToNM;
+
+	// Scale based on our FOV and Zoom. I did my initial
+	// light adjustments at a FOV of 60 so thats why
+	// I divide our current FOV by 60 to scale it appropriately.
+	distance *= sFOV / 60.0;
+	distance /= sCameraPos.zoom;
+
+	// Calculate our light size. This is piecewise linear. I noticed
+	// that light size changed more rapidly when closer than 3nm so
+	// I have a separate equation for that.
 	GLfloat size;
-	// Where are we looking?
-	XPLMCameraPosition_t cameraPos;
-	XPLMReadCameraPosition(&cameraPos);
+	if (distance <= 3.6)
+		size = (10.0f * static_cast<GLfloat>(distance)) + 1.0f;
+	else
+		size = (6.7f * static_cast<GLfloat>(distance)) + 12.0f;
+
+	// BEN SEZ: modulate the _alpha to make this dark, not
+	// the light color.  Otherwise if the sky is fairly light the light
+	// will be darker than the sky, which looks f---ed during the day.
+	const float fade = (static_cast<float>(distance) * -0.05882f) + 1.1764f;
+
+	bool on[light_Count];
+	on[light_NavRed] = on[light_NavGreen] = on[light_Other] = navLights;
+	on[light_Beacon] = bcnLights;
+	on[light_Strobe] = strbLights;
+	on[light_Landing] = landLights;
+	on[light_Taxi] = taxiLights;
+
+	// We can have 1 or more lights on each aircraft.  First pick out the ones that are on.
+	sLitLights.clear();
+	for (const LightInfo_t &light : obj->lods[lodIdx].lights)
+	{
+		if (!on[light.type])
+			continue;
+
+		// Where the light is - the plane's model matrix takes it from the plane's coordinates to ours.
+		LitLight_t lit;
+		const float * xyz = light.xyz;
+		for (int c = 0; c < 3; ++c)
+			lit.center[c] = m[c] * xyz[0] + m[4 + c] * xyz[1] + m[8 + c] * xyz[2] + m[12 + c];
+
+		// Strobes are a bit bigger.  They, the landing and the taxi lights use the right half of the
+		// texture's bottom, the others the left half of the top.
+		const bool bright = light.type == light_Strobe || light.type == light_Landing || light.type == light_Taxi;
+		lit.half = light.type == light_Strobe ? size / 1.5f : size / 2.0f;
+		lit.st[0] = bright ? 0.25f : 0.0f;
+		lit.st[1] = bright ? 0.0f : 0.5f;
+
+		for (int c = 0; c < 4; ++c)
+			lit.rgba[c] = light.color[c];
+		if (light.type == light_Landing || light.type == light_Taxi)
+			lit.rgba[3] *= fade;
+		sLitLights.push_back(lit);
+	}
+	ALLOC_NoteCapacity(sLitLights);
 
-	// We can have 1 or more lights on each aircraft
-	for (size_t n = 0; n < obj->lods[lodIdx].lights.size(); n++)
+	// Then grow the vertex array once for all of them and write their corners straight into place.
+	float right[3], up[3];
+	for (int c = 0; c < 3; ++c)
 	{
-		glMatrixMode(GL_MODELVIEW);
-		glPushMatrix();
-		// First we translate to our coordinate system and move the origin
-		// to the center of our lights.
-		glTranslatef(obj->lods[lodIdx].lights[n].xyz[0],
-			obj->lods[lodIdx].lights[n].xyz[1],
-			obj->lods[lodIdx].lights[n].xyz[2]);
-
-		// Now we undo the rotation of the plane
-		glRotated(-inRoll, 0.0, 0.0, -1.0);
-		glRotated(-inPitch, 1.0, 0.0, 0.0);
-		glRotated(-inHeading, 0.0, -1.0, 0.0);
-
-		// Now we undo the rotation of the camera
-		// NOTE: The order and sign of the camera is backwards
-		// from what we'd expect (the plane rotations) because
-		// the camera works backwards. If you pan right, everything
-		// else moves left!
-		glRotated(cameraPos.heading, 0.0, -1.0, 0.0);
-		glRotated(cameraPos.pitch, 1.0, 0.0, 0.0);
-		glRotated(cameraPos.roll, 0.0, 0.0, -1.0);
-
-		// Find our distance from the camera
-		float dx = cameraPos.x - static_cast<float>(inX);
-		float dy = cameraPos.y - static_cast<float>(inY);
-		float dz = cameraPos.z - static_cast<float>(inZ);
-		double distance = sqrt((dx * dx) + (dy * dy) + (dz * dz));
-
-		// Convert to NM
-		distance *= kMetersToNM;
-
-		// Scale based on our FOV and Zoom. I did my initial
-		// light adjustments at a FOV of 60 so thats why
-		// I divide our current FOV by 60 to scale it appropriately.
-		distance *= sFOV / 60.0;
-		distance /= cameraPos.zoom;
-
-		// Calculate our light size. This is piecewise linear. I noticed
-		// that light size changed more rapidly when closer than 3nm so
-		// I have a separate equation for that.
-		if (distance <= 3.6)
-			size = (10.0f * static_cast<GLfloat>(distance)) + 1.0f;
-		else
-			size = (6.7f * static_cast<GLfloat>(distance)) + 12.0f;
-
-		// Finally we can draw our lights
-		// Red Nav
-		glBegin(GL_QUADS);
-		if ((obj->lods[lodIdx].lights[n].rgb[0] == 11) &&
-			(obj->lods[lodIdx].lights[n].rgb[1] == 11) &&
-			(obj->lods[lodIdx].lights[n].rgb[2] == 11))
-		{
-			if (navLights) {
-				glColor4fv(kNavLightRed);
-				glTexCoord2f(0.0f, 0.5f); glVertex2f(-(size / 2.0f), -(size / 2.0f));
-				glTexCoord2f(0.0f, 1.0f); glVertex2f(-(size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.25f, 1.0f); glVertex2f((size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.25f, 0.5f); glVertex2f((size / 2.0f), -(size / 2.0f));
-			}
-		}
-		// Green Nav
-		else if ((obj->lods[lodIdx].lights[n].rgb[0] == 22) &&
-			(obj->lods[lodIdx].lights[n].rgb[1] == 22) &&
-			(obj->lods[lodIdx].lights[n].rgb[2] == 22))
-		{
-			if (navLights) {
-				glColor4fv(kNavLightGreen);
-				glTexCoord2f(0.0f, 0.5f); glVertex2f(-(size / 2.0f), -(size / 2.0f));
-				glTexCoord2f(0.0f, 1.0f); glVertex2f(-(size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.25f, 1.0f); glVertex2f((size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.25f, 0.5f); glVertex2f((size / 2.0f), -(size / 2.0f));
-			}
-		}
-		// Beacon
-		else if ((obj->lods[lodIdx].lights[n].rgb[0] == 33) &&
-			(obj->lods[lodIdx].lights[n].rgb[1] == 33) &&
-			(obj->lods[lodIdx].lights[n].rgb[2] == 33))
-		{
-			if (bcnLights)
-			{
-				glColor4fv(kNavLightRed);
-				glTexCoord2f(0.0f, 0.5f); glVertex2f(-(size / 2.0f), -(size / 2.0f));
-				glTexCoord2f(0.0f, 1.0f); glVertex2f(-(size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.25f, 1.0f); glVertex2f((size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.25f, 0.5f); glVertex2f((size / 2.0f), -(size / 2.0f));
-			}
-		}
-		// Strobes
-		else if ((obj->lods[lodIdx].lights[n].rgb[0] == 44) &&
-			(obj->lods[lodIdx].lights[n].rgb[1] == 44) &&
-			(obj->lods[lodIdx].lights[n].rgb[2] == 44))
-		{
-			if (strbLights)
-			{
-				glColor4fv(kStrobeLight);
-				glTexCoord2f(0.25f, 0.0f); glVertex2f(-(size / 1.5f), -(size / 1.5f));
-				glTexCoord2f(0.25f, 0.5f); glVertex2f(-(size / 1.5f), (size / 1.5f));
-				glTexCoord2f(0.50f, 0.5f); glVertex2f((size / 1.5f), (size / 1.5f));
-				glTexCoord2f(0.50f, 0.0f); glVertex2f((size / 1.5f), -(size / 1.5f));
-			}
-		}
-		// Landing Lights
-		else if ((obj->lods[lodIdx].lights[n].rgb[0] == 55) &&
-			(obj->lods[lodIdx].lights[n].rgb[1] == 55) &&
-			(obj->lods[lodIdx].lights[n].rgb[2] == 55))
+		right[c] = sCameraRight[c];
+		up[c] = sCameraUp[c];
+	}
+	const size_t first = sLightVertices.size();
+	sLightVertices.resize(first + 4 * sLitLights.size());
+	LightVertex_t * out = sLightVertices.data() + first;
+	for (size_t n = 0; n < sLitLights.size(); ++n)
+	{
+		const LitLight_t &lit = sLitLights[n];
+		for (int k = 0; k < 4; ++k)
 		{
-			if (landLights) {
-				// BEN SEZ: modulate the _alpha to make this dark, not
-				// the light color.  Otherwise if the sky is fairly light the light
-				// will be darker than the sky, which looks f---ed during the day.
-				float color[4];
-				color[0] = kLandingLight[0];
-				if (color[0] < 0.0) color[0] = 0.0;
-				color[1] = kLandingLight[1];
-				if (color[0] < 0.0) color[0] = 0.0;
-				color[2] = kLandingLight[2];
-				if (color[0] < 0.0) color[0] = 0.0;
-				color[3] = kLandingLight[3] * ((static_cast<float>(distance) * -0.05882f) + 1.1764f);
-				glColor4fv(color);
-				glTexCoord2f(0.25f, 0.0f); glVertex2f(-(size / 2.0f), -(size / 2.0f));
-				glTexCoord2f(0.25f, 0.5f); glVertex2f(-(size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.50f, 0.5f); glVertex2f((size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.50f, 0.0f); glVertex2f((size / 2.0f), -(size / 2.0f));
-			}
+			const float r = kLightCorners[k][0] * lit.half;
+			const float u = kLightCorners[k][1] * lit.half;
+			LightVertex_t &v = out[4 * n + k];
+			for (int c = 0; c < 3; ++c)
+				v.xyz[c] = lit.center[c] + r * right[c] + u * up[c];
+			v.st[0] = lit.st[0] + kLightCorners[k][2];
+			v.st[1] = lit.st[1] + kLightCorners[k][3];
+			for (int c = 0; c < 4; ++c)
+				v.rgba[c] = lit.rgba[c];
 		}
-		// taxi lights
-		else if ((obj->lods[lodIdx].lights[n].rgb[0] == 66) &&
-			(obj->lods[lodIdx].lights[n].rgb[1] == 66) &&
-			(obj->lods[lodIdx].lights[n].rgb[2] == 66))
-		{
-			if (taxiLights) {
-				float color[4];
-				color[0] = kTaxiLight[0];
-				if (color[0] < 0.0) color[0] = 0.0;
-				color[1] = kTaxiLight[1];
-				if (color[1] < 0.0) color[1] = 0.0;
-				color[2] = kTaxiLight[2];
-				if (color[2] < 0.0) color[2] = 0.0;
-				color[3] = kTaxiLight[3] * ((static_cast<float>(distance) * -0.05882f) + 1.1764f);
-				glColor4fv(color);
-				glTexCoord2f(0.25f, 0.0f); glVertex2f(-(size / 2.0f), -(size / 2.0f));
-				glTexCoord2f(0.25f, 0.5f); glVertex2f(-(size / 2.0f), -(size / 2.0f));
-				glTexCoord2f(0.50f, 0.5f); glVertex2f((size / 2.0f), (size / 2.0f));
-				glTexCoord2f(0.50f, 0.0f); glVertex2f((size / 2.0f), -(size / 2.0f));
-			}
-		} else {
-			// rear nav light and others? I guess...
-			if(navLights) {
-				glColor3f(
-						obj->lods[lodIdx].lights[n].rgb[0] * 0.1f,
-						obj->lods[lodIdx].lights[n].rgb[1] * 0.1f,
-						obj->lods[lodIdx].lights[n].rgb[2] * 0.1f);
-				glTexCoord2f(0.0f, 0.5f); glVertex2f(-(size/2.0f), -(size/2.0f));
-				glTexCoord2f(0.0f, 1.0f); glVertex2f(-(size/2.0f), (size/2.0f));
-				glTexCoord2f(0.25f, 1.0f); glVertex2f((size/2.0f), (size/2.0f));
-				glTexCoord2f(0.25f, 0.5f); glVertex2f((size/2.0f), -(size/2.0f));
-			}
-		}
-		glEnd();
-		// Put OpenGL back how we found it
-		glPopMatrix();
 	}
 }
 
+void	OBJ_EndLightDrawing()
+{
+	if (sLightVertices.empty())
+		return;
+
+	// Like compiling an OBJ's display list: our arrays live in our memory, so get X-Plane's VBO out of
+	// the way and keep its client state.
+	GLint xpBuffer = 0;
+#if IBM
+	if(glBindBufferARB)
+#endif
+	{
+		glGetIntegerv(GL_ARRAY_BUFFER_BINDING_ARB, &xpBuffer);
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+	}
+	glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+
+	const LightVertex_t &first = sLightVertices.front();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(LightVertex_t), first.xyz);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glColorPointer(4, GL_FLOAT, sizeof(LightVertex_t), first.rgba);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE1);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glClientActiveTextureARB(GL_TEXTURE0);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glTexCoordPointer(2, GL_FLOAT, sizeof(LightVertex_t), first.st);
+
+	glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(sLightVertices.size()));
+
+	glPopClientAttrib();
+#if IBM
+	if(glBindBufferARB)
+#endif
+		glBindBufferARB(GL_ARRAY_BUFFER_ARB, xpBuffer);
+
+	ALLOC_NoteCapacity(sLightVertices);
+	sLightVertices.clear();
+}
+
 int		OBJ_GetModelTexID(int model)
 {
 	if (model >= static_cast<int>(sObjects.size())) { return 0; }
@@ -39,6 +39,7 @@
 extern int xpmp_spare_texhandle_decay_frames;
 
 struct XPMPPlane_t;
+struct FrameContext_t;
 
 /*****************************************************
 			Ben's Crazy Point Pool Class
@@ -66,9 +67,23 @@ private:
 
 enum LoadStatus { Succeeded, Failed };
 
+// What a light is.  OBJ7 files say so with magic colors, which we look at once when loading.
+enum LightType {
+	light_NavRed,		// 11,11,11
+	light_NavGreen,		// 22,22,22
+	light_Beacon,		// 33,33,33 - red, flashing
+	light_Strobe,		// 44,44,44 - white, flashing
+	light_Landing,		// 55,55,55
+	light_Taxi,			// 66,66,66
+	light_Other,		// any other color, on with the nav lights
+	light_Count
+};
+
 struct	LightInfo_t {
 	float			xyz[3];
 	int				rgb[3];
+	LightType		type;
+	float			color[4];	// Landing and taxi lights fade out with distance on top of this
 };
 
 // One of these structs per LOD read from the OBJ file
@@ -121,13 +136,16 @@ std::string OBJ_DefaultModel(const std::string &path);
 // in if the user wants to override the default texture specified by the
 // obj file
 void	OBJ_PlotModel(XPMPPlane_t *plane, float inDistance, double inX, double inY,
-					  double inZ, double inPitch, double inRoll, double inHeading);
+					  double inZ, double inPitch, double inRoll, double inHeading, const FrameContext_t & inContext);
 
 // TEXTURED LIGHTS DRAWING
-void	OBJ_BeginLightDrawing();
-void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, double inX, double inY,
-					   double inZ, double inPitch, double inRoll, double inHeading,
+// Lights are billboards facing the camera, so OBJ_BeginLightDrawing takes the frame's view - and its time
+// for the flashing lights.  OBJ_DrawLights takes the plane's model matrix, see XPMPTransforms.  It only
+// collects the plane's lights; OBJ_EndLightDrawing draws all the lights collected since the begin in one go.
+void	OBJ_BeginLightDrawing(const FrameContext_t & inContext);
+void	OBJ_DrawLights(XPMPPlane_t *plane, float inDistance, const float * inModelMatrix,
 					   xpmp_LightStatus lights);
+void	OBJ_EndLightDrawing();
 
 // Texture loading
 int		OBJ_LoadLightTexture(const std::string &inFilePath, bool inForceMaxTex);
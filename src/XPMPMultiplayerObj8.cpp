@@ -23,6 +23,9 @@
 
 #include "XPMPMultiplayerObj8.h"
 #include "XPMPMultiplayerVars.h"
+#include "XPMPPrefs.h"
+#include "XPMPFrameContext.h"
+#include "XPMPAllocations.h"
 #include "XStringUtils.h"
 #include "XUtils.h"
 #include "XPLMScenery.h"
@@ -47,6 +50,17 @@ struct	one_inst {
 
 static one_inst *	s_cur_plane = nullptr;
 
+// All the places one object is drawn at, for OBJ8_EndBatch.
+struct Obj8Batch_t {
+	XPLMObjectRef					objectRef;
+	int								night;
+	std::vector<XPLMDrawInfo_t>		locations;
+};
+
+static bool							s_batching = false;
+static std::vector<Obj8Batch_t>		s_batches;		// Kept between frames, so the locations keep their storage
+static std::size_t					s_last_batch = 0;
+
 enum {
 	gear_rat = 0,
 	flap_rat,
@@ -69,7 +83,7 @@ enum {
 	dref_dim
 };
 
-const char * dref_names[dref_dim] = {
+const char * dref_names[dref_dim + 1] = {
 	"libxplanemp/controls/gear_ratio",
 	"libxplanemp/controls/flap_ratio",
 	"libxplanemp/controls/spoiler_ratio",
@@ -86,40 +100,44 @@ const char * dref_names[dref_dim] = {
 	"libxplanemp/controls/landing_lites_on",
 	"libxplanemp/controls/beacon_lites_on",
 	"libxplanemp/controls/strobe_lites_on",
-	"libxplanemp/controls/nav_lites_on"
+	"libxplanemp/controls/nav_lites_on",
+	nullptr
 };
 
 
-static float obj_get_float(void * inRefcon)
+static float dataref_value(intptr_t v, const XPLMPlaneDrawState_t &state, xpmp_LightStatus lights)
 {
-	if(s_cur_plane == nullptr) return 0.0f;
-	
-	intptr_t v = reinterpret_cast<intptr_t>(inRefcon);
 	switch(v)
 	{
-	case gear_rat:			return s_cur_plane->state->gearPosition;
-	case flap_rat:			return s_cur_plane->state->flapRatio;
-	case spoi_rat:			return s_cur_plane->state->spoilerRatio;
-	case sbrk_rat:			return s_cur_plane->state->speedBrakeRatio;
-	case slat_rat:			return s_cur_plane->state->slatRatio;
-	case swep_rat:			return s_cur_plane->state->wingSweep;
-	case thrs_rat:			return s_cur_plane->state->thrust;
-	case ptch_rat:			return s_cur_plane->state->yokePitch;
-	case head_rat:			return s_cur_plane->state->yokeHeading;
-	case roll_rat:			return s_cur_plane->state->yokeRoll;
-	case thrs_rev:			return static_cast<float>((s_cur_plane->state->thrust < 0.0) ? 1.0 : 0.0);	//if thrust less than zero, reverse is on
-
-	case tax_lite_on:		return static_cast<float>(s_cur_plane->lights.taxiLights);
-	case lan_lite_on:		return static_cast<float>(s_cur_plane->lights.landLights);
-	case bcn_lite_on:		return static_cast<float>(s_cur_plane->lights.bcnLights);
-	case str_lite_on:		return static_cast<float>(s_cur_plane->lights.strbLights);
-	case nav_lite_on:		return static_cast<float>(s_cur_plane->lights.navLights);
+	case gear_rat:			return state.gearPosition;
+	case flap_rat:			return state.flapRatio;
+	case spoi_rat:			return state.spoilerRatio;
+	case sbrk_rat:			return state.speedBrakeRatio;
+	case slat_rat:			return state.slatRatio;
+	case swep_rat:			return state.wingSweep;
+	case thrs_rat:			return state.thrust;
+	case ptch_rat:			return state.yokePitch;
+	case head_rat:			return state.yokeHeading;
+	case roll_rat:			return state.yokeRoll;
+	case thrs_rev:			return static_cast<float>((state.thrust < 0.0) ? 1.0 : 0.0);	//if thrust less than zero, reverse is on
+
+	case tax_lite_on:		return static_cast<float>(lights.taxiLights);
+	case lan_lite_on:		return static_cast<float>(lights.landLights);
+	case bcn_lite_on:		return static_cast<float>(lights.bcnLights);
+	case str_lite_on:		return static_cast<float>(lights.strbLights);
+	case nav_lite_on:		return static_cast<float>(lights.navLights);
 
 	default:
 		return 0.0f;
 	}
 }
 
+static float obj_get_float(void * inRefcon)
+{
+	if(s_cur_plane == nullptr) return 0.0f;
+	return dataref_value(reinterpret_cast<intptr_t>(inRefcon), *s_cur_plane->state, s_cur_plane->lights);
+}
+
 int obj_get_float_array(
 		void *               inRefcon,
 		float *              inValues,
@@ -299,7 +317,7 @@ void	obj_init()
 	// Ben says: we need the 2.10 SDK (e.g. X-Plane 10) to have async load at all.  But we need 10.30 to pick up an SDK bug
 	// fix where async load crashes if we queue a second load before the first completes.  So for users on 10.25, they get
 	// pauses.
-	if (1 == gIntPrefsFunc("debug", "allow_obj8_async_load", 0) && sim >= 10300) {
+	if (1 == gPrefs.debugAllowObj8AsyncLoad && sim >= 10300) {
 		obj8_load_async = true;	
 	} else {
 		obj8_load_async = false;
@@ -399,6 +417,7 @@ void OBJ_LoadObj8Async(const std::shared_ptr<XPMPPlane_t> &plane)
 		Obj8Info_t obj8Info;
 		obj8Info.index = plane->obj8Handles.size();
 		obj8Info.drawType = attachment.draw_type;
+		obj8Info.animated = attachment.needs_animation;
 		plane->obj8Handles[obj8Info] = nullptr;
 		std::string mtlCode = plane->model->getMtlCode();
 
@@ -444,7 +463,32 @@ void OBJ_LoadObj8Async(const std::shared_ptr<XPMPPlane_t> &plane)
 	}
 }
 
-void OBJ8_DrawModel(XPMPPlane_t *plane, double inX, double inY, double inZ, double inPitch, double inRoll, double inHeading, xpmp_LightStatus lights, XPLMPlaneDrawState_t *state, bool blend)
+// Queues one location of an object for OBJ8_EndBatch.  The renderer sorts planes by model, so the
+// batch we used last is usually the right one.
+static void batch_object(XPLMObjectRef objectRef, int night, const XPLMDrawInfo_t &location)
+{
+	if (s_last_batch >= s_batches.size() || s_batches[s_last_batch].objectRef != objectRef || s_batches[s_last_batch].night != night)
+	{
+		s_last_batch = 0;
+		while (s_last_batch < s_batches.size() &&
+			   (s_batches[s_last_batch].objectRef != objectRef || s_batches[s_last_batch].night != night))
+			++s_last_batch;
+		if (s_last_batch == s_batches.size())
+		{
+			ALLOC_NoteGrowth();		// An object that wasn't drawn last time gets a new batch
+			s_batches.push_back({ objectRef, night, {} });
+		}
+	}
+	// Batches trade places when one goes away, so each notes its own growth.
+	std::vector<XPLMDrawInfo_t> &locations = s_batches[s_last_batch].locations;
+	if (locations.size() == locations.capacity())
+		ALLOC_NoteGrowth();
+	locations.push_back(location);
+}
+
+// Draws those attachments of the plane that wanted() picks.
+template <typename Filter>
+static void draw_attachments(XPMPPlane_t *plane, double inX, double inY, double inZ, double inPitch, double inRoll, double inHeading, xpmp_LightStatus lights, XPLMPlaneDrawState_t *state, bool night, Filter wanted)
 {
 	for (auto &pair : plane->obj8Handles)
 	{
@@ -452,8 +496,7 @@ void OBJ8_DrawModel(XPMPPlane_t *plane, double inX, double inY, double inZ, doub
 		if (!obj8Handle) { return; }
 	}
 
-	static XPLMDataRef night_lighting_ref = XPLMFindDataRef("sim/graphics/scenery/percent_lights_on");
-	bool use_night = (plane->useNightTexture < 0) ? XPLMGetDataf(night_lighting_ref) > 0.25f : static_cast<bool>(plane->useNightTexture);
+	bool use_night = (plane->useNightTexture < 0) ? night : static_cast<bool>(plane->useNightTexture);
 
 	XPLMDrawInfo_t drawInfo;
 
@@ -475,12 +518,95 @@ void OBJ8_DrawModel(XPMPPlane_t *plane, double inX, double inY, double inZ, doub
 	for (const auto &pair : plane->obj8Handles)
 	{
 		auto obj8Handle = std::atomic_load(&pair.second);
-		if ((pair.first.drawType == draw_glass) == blend)
+		if (wanted(pair.first.drawType))
 		{
-			// drawType is whether the object is glass or solid, and blend is whether we are currently drawing glass objects or solid objects
-			XPLMDrawObjects(obj8Handle->objectRef, 1, &drawInfo, use_night, 0);
+			if (s_batching && !pair.first.animated && pair.first.drawType != draw_glass)
+				batch_object(obj8Handle->objectRef, use_night, drawInfo);
+			else
+				XPLMDrawObjects(obj8Handle->objectRef, 1, &drawInfo, use_night, 0);
 		}
 	}
 
 	s_cur_plane = nullptr;
 }
+
+void OBJ8_DrawModel(XPMPPlane_t *plane, double inX, double inY, double inZ, double inPitch, double inRoll, double inHeading, xpmp_LightStatus lights, XPLMPlaneDrawState_t *state, bool blend, int lod, const FrameContext_t &context)
+{
+	// Smaller planes get fewer attachments: from a distance just the LOW_LOD ones and the lights,
+	// and as a dot only the lights.  Models without them are drawn as they are.
+	bool hasLowLod = false;
+	bool hasLights = false;
+	for (const auto &pair : plane->obj8Handles)
+	{
+		hasLowLod |= (pair.first.drawType == draw_low_lod);
+		hasLights |= (pair.first.drawType == draw_lights);
+	}
+	const bool onlyLights = (lod == lod_Dot && hasLights);
+	const bool onlyLowLod = !onlyLights && lod != lod_Full && hasLowLod;
+
+	// drawType is whether the object is glass or solid, and blend is whether we are currently drawing glass objects or solid objects
+	draw_attachments(plane, inX, inY, inZ, inPitch, inRoll, inHeading, lights, state, context.night,
+					 [blend, onlyLights, onlyLowLod](obj_draw_type drawType)
+	{
+		if ((drawType == draw_glass) != blend) { return false; }
+		if (onlyLights) { return drawType == draw_lights; }
+		if (onlyLowLod) { return drawType == draw_low_lod || drawType == draw_lights; }
+		return true;
+	});
+}
+
+void OBJ8_DrawShadowModel(XPMPPlane_t *plane, double inX, double inY, double inZ, double inPitch, double inRoll, double inHeading, XPLMPlaneDrawState_t *state, const FrameContext_t &context)
+{
+	// Prefer the LOW_LOD attachments if the model has any, otherwise all solid ones.
+	// Lights and glass don't cast shadows.
+	bool hasLowLod = false;
+	for (const auto &pair : plane->obj8Handles)
+		if (pair.first.drawType == draw_low_lod)
+			hasLowLod = true;
+
+	xpmp_LightStatus noLights;
+	noLights.lightFlags = 0;
+	draw_attachments(plane, inX, inY, inZ, inPitch, inRoll, inHeading, noLights, state, context.night,
+					 [hasLowLod](obj_draw_type drawType) { return hasLowLod ? drawType == draw_low_lod : drawType == draw_solid; });
+}
+
+const char **	OBJ8_DatarefNames()
+{
+	return dref_names;
+}
+
+int		OBJ8_DatarefCount()
+{
+	return dref_dim;
+}
+
+void	OBJ8_DatarefValues(const XPLMPlaneDrawState_t &state, xpmp_LightStatus lights, float * outValues)
+{
+	for (int i = 0; i < dref_dim; ++i)
+		outValues[i] = dataref_value(i, state, lights);
+}
+
+void OBJ8_BeginBatch()
+{
+	s_batching = true;
+}
+
+void OBJ8_EndBatch()
+{
+	s_batching = false;
+
+	// Objects nobody used this time give up their batch, the others keep it for the next frame.
+	for (std::size_t n = 0; n < s_batches.size(); )
+	{
+		Obj8Batch_t &batch = s_batches[n];
+		if (batch.locations.empty())
+		{
+			std::swap(batch, s_batches.back());
+			s_batches.pop_back();
+			continue;
+		}
+		XPLMDrawObjects(batch.objectRef, static_cast<int>(batch.locations.size()), batch.locations.data(), batch.night, 0);
+		batch.locations.clear();
+		++n;
+	}
+}
@@ -112,6 +112,7 @@ void	obj_init();
 
 struct CSLPlane_t;
 struct XPMPPlane_t;
+struct FrameContext_t;
 
 void OBJ_LoadObj8Async(const std::shared_ptr<XPMPPlane_t> &plane);
 OBJ8Handle OBJ_LoadObj8Model(const std::string &inFilePath);
@@ -126,8 +127,34 @@ void OBJ8_DrawModel(
     double inHeading,
     xpmp_LightStatus lights,
     XPLMPlaneDrawState_t *state,
-    bool blend);
+    bool blend,
+    int lod,
+    const FrameContext_t &context);
 
+// Draws the plane into a shadow map: only the LOW_LOD attachments if there are any, and never lights or glass.
+void OBJ8_DrawShadowModel(
+    XPMPPlane_t *plane,
+    double inX,
+    double inY,
+    double inZ,
+    double inPitch,
+    double inRoll,
+    double inHeading,
+    XPLMPlaneDrawState_t *state,
+    const FrameContext_t &context);
+
+// Our libxplanemp/controls datarefs, for drawing OBJ8s without a draw callback: their names, null
+// terminated, how many there are, and what they read for one plane, in the same order.
+const char **	OBJ8_DatarefNames();
+int		OBJ8_DatarefCount();
+void	OBJ8_DatarefValues(const XPLMPlaneDrawState_t &state, xpmp_LightStatus lights, float * outValues);
+
+// Attachments that don't need animation look the same on every plane.  Between OBJ8_BeginBatch and
+// OBJ8_EndBatch, the draw functions only collect where they go, and OBJ8_EndBatch draws each of
+// these objects with one call for all the planes.  Animated attachments and glass are still drawn
+// right away - glass has to stay back to front.
+void OBJ8_BeginBatch();
+void OBJ8_EndBatch();
 
 void	obj_deinit();
 
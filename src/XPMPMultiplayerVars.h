@@ -74,9 +74,17 @@ enum {
 	plane_Lights,
 	plane_Obj8,
 	plane_Obj8_Transparent,
+	plane_Obj8_Shadow,
 	plane_Count
 };
 
+// How much of a plane we draw, by its size on screen.
+enum {
+	lod_Dot,			// Less than a pixel - only its lights
+	lod_Lites,			// Small - lights and the lowest LOD
+	lod_Full
+};
+
 enum class eVertOffsetType {
 	none = 0,
 	default_offset,
@@ -206,6 +214,7 @@ struct Obj8Info_t
 {
     size_t index;
 	obj_draw_type drawType;
+	bool animated = true;		// Reads our per plane datarefs, see obj_for_acf::needs_animation
 
 	bool operator <(const Obj8Info_t& rhs) const
 	{
@@ -234,17 +243,49 @@ struct	XPMPPlane_t {
 	// This is last known data we got for the plane, with timestamps.
 	int						posAge;
 	XPMPPlanePosition_t		pos;
+	int						labelPriority = 0;	// See XPMPSetPlaneLabelPriority
 
 	int						surfaceAge;
 	XPMPPlaneSurfaces_t		surface;
 	int						radarAge;
 	XPMPPlaneRadar_t		radar;
 
+	// When the position and surfaces last really changed - clients may send the same data every
+	// frame.  Planes where neither changed for a while count as parked, and are asked less often.
+	int						posChanged = 0;
+	int						surfaceChanged = 0;
+	int						nextPoll = 0;		// Far or parked planes aren't asked again before this cycle
+
+	// Planes out of range hibernate, and are only asked about once a second.
+	float					lastDistance = 0.0f;	// Meters to the camera or our plane, whichever is closer, when last seen
+	float					backgroundPoll = 0.0f;	// Elapsed time a hibernating plane is due again
+
+	// Local coordinates of the position as of posChanged, while the local frame is localSerial.
+	unsigned				localSerial = 0;	// 0 if we have none
+	int						localStamp = 0;
+	double					localX = 0.0;
+	double					localY = 0.0;
+	double					localZ = 0.0;
+
 	OBJ7Handle                  objHandle;
 	TextureHandle               texHandle;
 	TextureHandle               texLitHandle;
 
 	int						tcasIndex = -1;
+	int						spatialTile = -1;	// Where we are filed in the spatial index, -1 if we aren't
+	std::size_t				spatialSlot = 0;
+	std::size_t				backgroundSlot = 0;	// Where we are in the spatial index' background queue
+
+	// The renderer's last frustum test of this plane, reused while nothing moved much.
+	unsigned				cullEpoch = 0;
+	float					cullX = 0.0f;		// Where the plane was
+	float					cullY = 0.0f;
+	float					cullZ = 0.0f;
+	float					cullMove = 0.0f;	// How far the camera had moved and turned by then
+	float					cullTurn = 0.0f;
+	float					cullMargin = 0.0f;	// Meters in or outside of the frustum
+	bool					cullVisible = false;
+
 	int						useNightTexture = -1; // -1 .. auto, from data ref "sim/graphics/scenery/percent_lights_on", 0 .. no, 1.. yes
 
 	std::map<Obj8Info_t, OBJ8Handle> obj8Handles;
@@ -29,6 +29,20 @@
 #include "XPMPMultiplayerVars.h"
 #include "XPMPMultiplayerObj.h"
 #include "XPMPMultiplayerObj8.h"
+#include "XPMPPrefs.h"
+#include "XPMPRenderQueue.h"
+#include "XPMPAllocations.h"
+#include "XPMPScheduler.h"
+#include "XPMPCulling.h"
+#include "XPMPFrameContext.h"
+#include "XPMPGovernor.h"
+#include "XPMPImpostors.h"
+#include "XPMPInstances.h"
+#include "XPMPLabels.h"
+#include "XPMPLocalFrame.h"
+#include "XPMPSpatialIndex.h"
+#include "XPMPTransforms.h"
+#include "XPMPWorkerPool.h"
 
 #include "XPLMGraphics.h"
 #include "XPLMDisplay.h"
@@ -36,9 +50,11 @@
 #include "XPLMPlanes.h"
 #include "XPLMUtilities.h"
 #include "XPLMDataAccess.h"
+#include "XPLMProcessing.h"
 
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 #include <algorithm>
 #include <bitset>
 
@@ -54,6 +70,7 @@
 #include <string>
 #include <set>
 #include <map>
+#include <thread>
 
 // Turn this on to get a lot of diagnostic info on who's visible, etc.
 #define		DEBUG_RENDERER 0
@@ -97,10 +114,9 @@ bool isValidTcasIndex(int i)
 
 int DebugRenderPhase(XPLMDrawingPhase, int isBefore, void *refcon)
 {
-    const std::string prefix = isBefore ? "before" : "after";
-	const std::string phase = static_cast<const char *>(refcon);
-	const std::string message = "DEBUG: " + prefix + " " + phase + "\n";
-	XPLMDebugString(message.c_str());
+	char message[128];
+	snprintf(message, sizeof(message), "DEBUG: %s %s\n", isBefore ? "before" : "after", static_cast<const char *>(refcon));
+	XPLMDebugString(message);
 	return 1;
 }
 
@@ -129,130 +145,15 @@ static void init_debugRenderPhases()
 
 static bool gDrawLabels = true;
 
-struct cull_info_t {					// This struct has everything we need to cull fast!
-	float	model_view[16];				// The model view matrix, to get from local OpenGL to eye coordinates.
-	float	proj[16];					// Proj matrix - this is just a hack to use for gluProject.
-	float	nea_clip[4];				// Four clip planes in the form of Ax + By + Cz + D = 0 (ABCD are in the array.)
-	float	far_clip[4];				// They are oriented so the positive side of the clip plane is INSIDE the view volume.
-	float	lft_clip[4];
-	float	rgt_clip[4];
-	float	bot_clip[4];
-	float	top_clip[4];
-};
-
-static bool				gCullInfoInitialised = false;
-static XPLMDataRef		projectionMatrixRef = nullptr;
-static XPLMDataRef		modelviewMatrixRef = nullptr;
-static XPLMDataRef		viewportRef = nullptr;
-
-static bool				gMSAAHackInitialised = false;
-static XPLMDataRef		gMSAAXRatioRef = nullptr;
-static XPLMDataRef		gMSAAYRatioRef = nullptr;
-static XPLMDataRef		gHDROnRef = nullptr;
-
-static XPLMDataRef		gOwnPlaneX = nullptr;
-static XPLMDataRef		gOwnPlaneY = nullptr;
-static XPLMDataRef		gOwnPlaneZ = nullptr;
-
-static void init_cullinfo()
+// Projects a point in local coordinates onto the screen.  mvp is projection * model view.
+static void convert_to_2d(const float * mvp, const int * vp, const float * xyz, float * out_x, float * out_y)
 {
-	modelviewMatrixRef = XPLMFindDataRef("sim/graphics/view/modelview_matrix");
-	projectionMatrixRef = XPLMFindDataRef("sim/graphics/view/projection_matrix");
-	viewportRef = XPLMFindDataRef("sim/graphics/view/viewport");
-	gCullInfoInitialised = true;
-}
+	float xc = xyz[0] * mvp[0] + xyz[1] * mvp[4] + xyz[2] * mvp[ 8] + mvp[12];
+	float yc = xyz[0] * mvp[1] + xyz[1] * mvp[5] + xyz[2] * mvp[ 9] + mvp[13];
+	float wc = xyz[0] * mvp[3] + xyz[1] * mvp[7] + xyz[2] * mvp[11] + mvp[15];
 
-static void setup_cull_info(cull_info_t * i)
-{
-	if (!gCullInfoInitialised) {
-		init_cullinfo();
-	}
-	// First, just read out the current OpenGL matrices...do this once at setup
-	// because it's not the fastest thing to do.
-	//
-	// if our X-Plane version supports it, pull it from the daatrefs to avoid a
-	// potential driver stall.
-	if (!modelviewMatrixRef || !projectionMatrixRef) {
-		glGetFloatv(GL_MODELVIEW_MATRIX, i->model_view);
-		glGetFloatv(GL_PROJECTION_MATRIX, i->proj);
-	} else {
-		XPLMGetDatavf(modelviewMatrixRef, i->model_view, 0, 16);
-		XPLMGetDatavf(projectionMatrixRef, i->proj, 0, 16);
-	}
-
-	// Now...what the heck is this?  Here's the deal: the clip planes have values in "clip" coordinates of: Left = (1,0,0,1)
-	// Right = (-1,0,0,1), Bottom = (0,1,0,1), etc.  (Clip coordinates are coordinates from -1 to 1 in XYZ that the driver
-	// uses.  The projection matrix converts from eye to clip coordinates.)
-	//
-	// How do we convert a plane backward from clip to eye coordinates?  Well, we need the transpose of the inverse of the
-	// inverse of the projection matrix.  (Transpose of the inverse is needed to transform a plane, and the inverse of the
-	// projection is the matrix that goes clip -> eye.)  Well, that cancels out to the transpose of the projection matrix,
-	// which is nice because it means we don't need a matrix inversion in this bit of sample code.
-	
-	// So this nightmare down here is simply:
-	// clip plane * transpose (proj_matrix)
-	// worked out for all six clip planes.  If you squint you can see the patterns:
-	// L:  1  0 0 1
-	// R: -1  0 0 1
-	// B:  0  1 0 1
-	// T:  0 -1 0 1
-	// etc.
-	
-	i->lft_clip[0] = i->proj[0]+i->proj[3];	i->lft_clip[1] = i->proj[4]+i->proj[7];	i->lft_clip[2] = i->proj[8]+i->proj[11];	i->lft_clip[3] = i->proj[12]+i->proj[15];
-	i->rgt_clip[0] =-i->proj[0]+i->proj[3];	i->rgt_clip[1] =-i->proj[4]+i->proj[7];	i->rgt_clip[2] =-i->proj[8]+i->proj[11];	i->rgt_clip[3] =-i->proj[12]+i->proj[15];
-	
-	i->bot_clip[0] = i->proj[1]+i->proj[3];	i->bot_clip[1] = i->proj[5]+i->proj[7];	i->bot_clip[2] = i->proj[9]+i->proj[11];	i->bot_clip[3] = i->proj[13]+i->proj[15];
-	i->top_clip[0] =-i->proj[1]+i->proj[3];	i->top_clip[1] =-i->proj[5]+i->proj[7];	i->top_clip[2] =-i->proj[9]+i->proj[11];	i->top_clip[3] =-i->proj[13]+i->proj[15];
-
-	i->nea_clip[0] = i->proj[2]+i->proj[3];	i->nea_clip[1] = i->proj[6]+i->proj[7];	i->nea_clip[2] = i->proj[10]+i->proj[11];	i->nea_clip[3] = i->proj[14]+i->proj[15];
-	i->far_clip[0] =-i->proj[2]+i->proj[3];	i->far_clip[1] =-i->proj[6]+i->proj[7];	i->far_clip[2] =-i->proj[10]+i->proj[11];	i->far_clip[3] =-i->proj[14]+i->proj[15];
-}
-
-static int sphere_is_visible(const cull_info_t * i, float x, float y, float z, float r)
-{
-	// First: we transform our coordinate into eye coordinates from model-view.
-	float xp = x * i->model_view[0] + y * i->model_view[4] + z * i->model_view[ 8] + i->model_view[12];
-	float yp = x * i->model_view[1] + y * i->model_view[5] + z * i->model_view[ 9] + i->model_view[13];
-	float zp = x * i->model_view[2] + y * i->model_view[6] + z * i->model_view[10] + i->model_view[14];
-
-	// Now - we apply the "plane equation" of each clip plane to see how far from the clip plane our point is.
-	// The clip planes are directed: positive number distances mean we are INSIDE our viewing area by some distance;
-	// negative means outside.  So ... if we are outside by less than -r, the ENTIRE sphere is out of bounds.
-	// We are not visible!  We do the near clip plane, then sides, then far, in an attempt to try the planes
-	// that will eliminate the most geometry first...half the world is behind the near clip plane, but not much is
-	// behind the far clip plane on sunny day.
-	if ((xp * i->nea_clip[0] + yp * i->nea_clip[1] + zp * i->nea_clip[2] + i->nea_clip[3] + r) < 0)	return false;
-	if ((xp * i->bot_clip[0] + yp * i->bot_clip[1] + zp * i->bot_clip[2] + i->bot_clip[3] + r) < 0)	return false;
-	if ((xp * i->top_clip[0] + yp * i->top_clip[1] + zp * i->top_clip[2] + i->top_clip[3] + r) < 0)	return false;
-	if ((xp * i->lft_clip[0] + yp * i->lft_clip[1] + zp * i->lft_clip[2] + i->lft_clip[3] + r) < 0)	return false;
-	if ((xp * i->rgt_clip[0] + yp * i->rgt_clip[1] + zp * i->rgt_clip[2] + i->rgt_clip[3] + r) < 0)	return false;
-	if ((xp * i->far_clip[0] + yp * i->far_clip[1] + zp * i->far_clip[2] + i->far_clip[3] + r) < 0)	return false;
-	return true;
-}
-
-static float sphere_distance_sqr(const cull_info_t * i, float x, float y, float z)
-{
-	float xp = x * i->model_view[0] + y * i->model_view[4] + z * i->model_view[ 8] + i->model_view[12];
-	float yp = x * i->model_view[1] + y * i->model_view[5] + z * i->model_view[ 9] + i->model_view[13];
-	float zp = x * i->model_view[2] + y * i->model_view[6] + z * i->model_view[10] + i->model_view[14];
-	return xp*xp+yp*yp+zp*zp;
-}
-
-static void convert_to_2d(const cull_info_t * i, const int * vp, float x, float y, float z, float w, float * out_x, float * out_y)
-{
-	float xe = x * i->model_view[0] + y * i->model_view[4] + z * i->model_view[ 8] + w * i->model_view[12];
-	float ye = x * i->model_view[1] + y * i->model_view[5] + z * i->model_view[ 9] + w * i->model_view[13];
-	float ze = x * i->model_view[2] + y * i->model_view[6] + z * i->model_view[10] + w * i->model_view[14];
-	float we = x * i->model_view[3] + y * i->model_view[7] + z * i->model_view[11] + w * i->model_view[15];
-
-	float xc = xe * i->proj[0] + ye * i->proj[4] + ze * i->proj[ 8] + we * i->proj[12];
-	float yc = xe * i->proj[1] + ye * i->proj[5] + ze * i->proj[ 9] + we * i->proj[13];
-	//	float zc = xe * i->proj[2] + ye * i->proj[6] + ze * i->proj[10] + we * i->proj[14];
-	float wc = xe * i->proj[3] + ye * i->proj[7] + ze * i->proj[11] + we * i->proj[15];
-	
 	xc /= wc;
 	yc /= wc;
-	//	zc /= wc;
 
 	*out_x = static_cast<float>(vp[0]) + (1.0f + xc) * static_cast<float>(vp[2]) / 2.0f;
 	*out_y = static_cast<float>(vp[1]) + (1.0f + yc) * static_cast<float>(vp[3]) / 2.0f;
@@ -272,28 +173,36 @@ static	int		gTotPlanes = 0;			// Counters
 static	int		gACFPlanes = 0;			// Number of Austin's planes we drew in full
 static	int		gNavPlanes = 0;			// Number of Austin's planes we drew with lights only
 static	int		gOBJPlanes = 0;			// Number of our OBJ planes we drew in full
+static	int		gSavedStateChanges = 0;	// GL state changes the state cache skipped
 
-static	XPLMDataRef		gVisDataRef  = nullptr;		// Current air visiblity for culling.
-static	XPLMDataRef		gAltitudeRef = nullptr;;	// Current aircraft altitude (for TCAS)
 static	XPLMProbeRef	terrainProbe = nullptr;;	// Probe to probe where the ground is for clamping
 
 
+static void init_tasks();		// Further down, next to the tasks themselves
+
+// Leave most cores to the sim - we only need a few for classifying planes.  Starts the pool
+// over if the planes:worker_threads pref changed.
+static void start_workers()
+{
+	const int threads = std::max(std::min(static_cast<int>(gPrefs.workerThreads), static_cast<int>(std::thread::hardware_concurrency()) - 1), 0);
+	if (static_cast<int>(gWorkerPool.workerCount()) - 1 != threads)
+		gWorkerPool.start(static_cast<unsigned>(threads));
+}
+static bool		gWorkersFollowPrefs = false;
+
 void			XPMPInitDefaultPlaneRenderer(void)
 {
 	XPLMDestroyProbe(terrainProbe);
 	terrainProbe = XPLMCreateProbe(xplm_ProbeY);
-	
-	// SETUP - mostly just fetch datarefs.
 
-	if (!gCullInfoInitialised) {
-		init_cullinfo();
+	start_workers();
+	if (!gWorkersFollowPrefs)
+	{
+		gWorkersFollowPrefs = true;
+		PREFS_OnChange(start_workers);
 	}
-	gVisDataRef = XPLMFindDataRef("sim/graphics/view/visibility_effective_m");
-	if (!gVisDataRef) gVisDataRef = XPLMFindDataRef("sim/weather/visibility_effective_m");
-	if (!gVisDataRef)
-		XPLMDebugString("WARNING: Default renderer could not find effective visibility in the sim.\n");
 
-	if(!gAltitudeRef) gAltitudeRef = XPLMFindDataRef("sim/flightmodel/position/elevation");
+	init_tasks();
 
 #if RENDERER_STATS
 	XPLMRegisterDataAccessor("hack/renderer/planes", xplmType_Int, 0, GetRendererStat, NULL,
@@ -308,9 +217,12 @@ void			XPMPInitDefaultPlaneRenderer(void)
 	XPLMRegisterDataAccessor("hack/renderer/acfs", xplmType_Int, 0, GetRendererStat, NULL,
 							 NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
 							 &gACFPlanes, NULL);
+	XPLMRegisterDataAccessor("hack/renderer/saved_state_changes", xplmType_Int, 0, GetRendererStat, NULL,
+							 NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+							 &gSavedStateChanges, NULL);
 #endif
 
-	if (gIntPrefsFunc("debug", "render_phases", 0))
+	if (gPrefs.debugRenderPhases)
 	{
 		init_debugRenderPhases(); // log all render phases if needed
 	}
@@ -343,6 +255,13 @@ void			XPMPInitDefaultPlaneRenderer(void)
 void XPMPDeinitDefaultPlaneRenderer() {
 	XPLMDestroyProbe(terrainProbe);
 	terrainProbe = nullptr;
+	IMP_Cleanup();
+	LABEL_Cleanup();
+#if XPMP_INSTANCING
+	INST_Cleanup();
+#endif
+	GOV_Cleanup();
+	gWorkerPool.stop();
 }
 
 double getCorrectYValue(double inX, double inY, double inZ, double inModelYOffset, bool inIsClampingOn) {
@@ -369,151 +288,375 @@ struct	PlaneToRender_t {
 	float					z;
 	XPMPPlanePtr			plane;
 	bool					full;		// Do we need to draw the full plane or just lites?
+	bool					dot;		// Less than a pixel on screen, only draw its lights
+	float					lodDist;	// How far away the plane looks, for picking OBJ7 LODs
+	int						impostor;	// Atlas slot if we draw it as an impostor, -1 if not
 	bool					cull;		// Are we visible on screen?
-	bool					tcas;		// Are we visible on TCAS?
 	XPLMPlaneDrawState_t	state;		// Flaps, gear, etc.
 	float					dist;
+	uint32_t				snapshot;	// Index into the traffic frame, for culling again
 };
-typedef	std::map<double, PlaneToRender_t>	DistanceMap;
 
-// We calculate the screen coordinates during 3D rendering
-// and actually draw the labels during 2D rendering,
-// so we need to store the coordinates somewhere:
-struct LabelToRender_t {
-	float x;
-	float y;
-	const char *text;
+// Where one plane is and what state it is in, as far as the flight loop found out.
+struct	PlaneSnapshot_t {
+	XPMPPlanePtr			plane;		// nullptr if the plane was destroyed since
+	bool					polled;		// Did we ask the client this frame, or is the plane parked?
+	XPMPPlanePosition_t		pos;
+	double					x;			// Local OpenGL coordinates
+	double					y;
+	double					z;
+	double					ownDist;	// Distance to our own plane
+	double					cameraDist;	// Distance to the camera, as of the flight loop
+	bool					hasRadar;	// Radar and surfaces are only pulled for planes within TCAS range
+	XPMPPlaneRadar_t		radar;
+	bool					hasSurfaces;
+	XPMPPlaneSurfaces_t		surfaces;
+	bool					tcas;		// Are we visible on TCAS?
+	XPLMPlaneDrawState_t	state;		// Flaps, gear, etc.
+	bool					instanced = false;	// X-Plane draws it for us, see XPMPInstances
 };
-static std::vector<LabelToRender_t> gLabels;
 
+// A traffic frame is everything the flight loop found out about the planes that are in range.
+// The flight loop builds one while the draw callbacks read the other, which is never changed
+// once published - so drawing does no callbacks into client code at all.
+struct	TrafficFrame_t {
+	unsigned						serial = 0;			// Counts up with every frame built
+	long							planeCount = 0;		// All planes, not just the ones in range
+	std::vector<PlaneSnapshot_t>	planes;
+	CullSpheres_t					spheres;			// Bounding spheres, parallel to planes
+	PlaneMatrices_t					matrices;			// Model matrices, parallel to planes
+};
+static TrafficFrame_t	gTrafficFrames[2];
+static int				gDrawFrame = 0;					// The one the draw callbacks read
+
+// Flight loop scratch space.
+static std::vector<XPMPPlanePtr>	gCandidates;
+static LocalBatch_t					gGeoBatch;			// Parallel to the frame's planes
+static AttitudeBatch_t				gAttitudes;			// Parallel to the frame's spheres
+static std::vector<uint32_t>		gGeoSnapshots;		// Which snapshot each entry of gGeoBatch is for
+static RenderQueue					gTcasQueue;			// TCAS planes - sorted by aircraft distance
+
+// Bounding sphere radius we cull planes with, in meters.
+static const float	kPlaneCullRadius = 50.0f;
+
+// Level of detail goes by how big a plane is on screen.  Distance based settings - the
+// planes/full_distance pref and OBJ7 LOD ranges - are taken to mean distances in a reference
+// view 60 degrees high and 1080 pixels tall, where one radian covers this many pixels.
+static const float	kRefPixelsPerRadian = 935.3f;
+
+// Planes with a smaller radius on screen, in pixels, are only drawn as their lights.
+static const float	kDotPixels = 1.0f;
+
+// How many planes one worker classifies at a time.
+static const std::size_t	kClassifyChunk = 128;
+
+// A plane whose position and surfaces haven't changed for this many cycles is parked.  We only
+// ask parked planes for their data every kParkedPollInterval cycles, and keep everything else.
+static const int	kParkedCycles = 60;
+static const int	kParkedPollInterval = 15;
+
+// Planes farther away are asked less often, and hold their position in between.  By the last
+// distance we saw them at, to the camera or our plane: beyond each distance, every interval cycles.
+struct PollTier_t {
+	float	distance;
+	int		interval;
+};
+static const PollTier_t	kPollTiers[] = { { 10000.0f, 2 }, { 25000.0f, 4 } };
+
+// Beyond TCAS range plus this much, planes hibernate - see SPATIAL_RefreshBackground.  About
+// what a fast jet covers between two hibernation polls.
+static const float	kHibernateMargin = 5000.0f;
+
+// How many labels one worker projects at a time.
+static const std::size_t	kLabelChunk = 64;
+
+// Scratch space for classifying, and the queue of what to draw this pass.  All of them keep
+// their storage from frame to frame, so a steady state frame does no heap allocation for them.
+// Workers classify into a list each, which we merge.
+static CullResults_t				gCullResults;
+static std::vector<std::vector<PlaneToRender_t>>	gClassified;
+static RenderQueue					gDrawQueue;			// What to draw this pass, in OpenGL order
+
+// X-Plane calls us several times per frame: solid and blend, shadows, and once per eye in VR.
+// The render records only depend on the traffic frame and the view, so we classify once per
+// frame and later passes reuse them - culling again if the view changed, and measuring and
+// sorting again if the eye moved.  Shadow passes look from the sun and budget by their own
+// rules, so they keep records of their own, measured from the camera.
+struct	RenderView_t {
+	int				cycle = -1;			// XPLMGetCycleNumber of the pass that classified
+	unsigned		frameSerial = 0;	// Traffic frame the records came from
+	float			model_view[16];		// View we last culled against
+	float			proj[16];
+	float			eye[3];				// Where we measured the distances from
+	std::vector<PlaneToRender_t>	records;
+	RenderQueue		distanceQueue;		// Indices into records, closest first so we can do the closest N and bail
+};
+static RenderView_t		gMainView;
+static RenderView_t		gShadowView;
+static CullResults_t	gViewCullResults;		// Culling for the other views of a frame
+
+// Planes move a few meters per frame, so most of them are nowhere near the edge of the frustum.
+// A plane's last frustum test stays good until the plane and the camera together moved further
+// than its margin; for the camera we sum up how far it moved and turned since the epoch started.
+// A new projection (zoom) starts a new epoch and everyone is tested again.  Only the main view
+// keeps track of this - shadow views are tested from scratch every time.
+struct	CullCoherence_t {
+	unsigned		epoch = 0;
+	cull_info_t		view;				// View of the last classification
+	float			move = 0.0f;		// Meters the camera moved in this epoch
+	float			turn = 0.0f;		// Radians it turned
+};
+static CullCoherence_t			gCoherence;
+static CullSpheres_t			gDirtySpheres;		// Planes we have to test again
+static std::vector<uint32_t>	gDirtyPlanes;		// Their index in the traffic frame
+static std::vector<float>		gEyeDistance;		// Parallel to the traffic frame
 
-void			XPMPDefaultPlaneRenderer(int is_blend)
-{
-	long	planeCount = XPMPCountPlanes();
-#if DEBUG_RENDERER
-	char	buf[50];
-	sprintf(buf,"Renderer Planes: %d\n", planeCount);
-	XPLMDebugString(buf);
-#endif
-	if (planeCount == 0)		// Quick exit if no one's around.
-	{
-		for (auto &ref : gMultiRefs) { ref.resetValues(); }
-		gLabels.clear();
-		gEnableCount = 1;
-		if (gDumpOneRenderCycle)
-		{
-			gDumpOneRenderCycle = false;
-			XPLMDebugString("No planes this cycle.\n");
-		}
-		return;
-	}
+// Start over before the sums lose too much precision.
+static const float	kCoherenceMaxMove = 10000.0f;
 
-	if (!gMSAAHackInitialised) {
-		gMSAAHackInitialised = true;
-		gMSAAXRatioRef = XPLMFindDataRef("sim/private/controls/hdr/fsaa_ratio_x");
-		gMSAAYRatioRef = XPLMFindDataRef("sim/private/controls/hdr/fsaa_ratio_y");
-		gHDROnRef      = XPLMFindDataRef("sim/graphics/settings/HDR_on");
-	}
+// Below this governor detail level, planes that are only a dot don't get their lights drawn.
+static const float	kGovernorDotLights = 0.5f;
 
-	if (!gOwnPlaneX) {
-		gOwnPlaneX = XPLMFindDataRef("sim/flightmodel/position/local_x");
-		gOwnPlaneY = XPLMFindDataRef("sim/flightmodel/position/local_y");
-		gOwnPlaneZ = XPLMFindDataRef("sim/flightmodel/position/local_z");
-	}
+// Work that doesn't have to happen every frame.  See init_tasks for what runs when.
+static TaskScheduler	gFlightLoopTasks;
+static TaskScheduler	gDrawTasks;				// These need a GL context
 
-	cull_info_t			gl_camera;
-	setup_cull_info(&gl_camera);
-	XPLMCameraPosition_t x_camera;
+static const float		kTcasRankHz = 4.0f;
+static const float		kPrefsRefreshHz = 1.0f;
+static const float		kTextureMaintenanceHz = 10.0f;
+static const std::size_t	kBackgroundChunk = 16;	// Background polls between two looks at the clock
 
-	XPLMReadCameraPosition(&x_camera);	// only for zoom!
+// The number of planes in range has been the same for this many frames - a frame should then
+// only allocate where scratch space grows past its high-water mark.  See XPMPAllocations.
+static const int		kSteadyFrames = 60;
+static int				gSteadyFrames = 0;
 
-	// Culling - read the camera pos«and figure out what's visible.
+static std::vector<ImpostorInstance_t>	gImpostors;
 
-	const double	maxDist = XPLMGetDataf(gVisDataRef);
-	const double	labelDist = std::min(maxDist, MAX_LABEL_DIST) * x_camera.zoom;		// Labels get easier to see when users zooms.
-	const double	fullPlaneDist = x_camera.zoom * (5280.0 / 3.2) * (gFloatPrefsFunc ? gFloatPrefsFunc("planes","full_distance", 3.0) : 3.0);	// Only draw planes fully within 3 miles.
-	const int		maxFullPlanes = gIntPrefsFunc ? gIntPrefsFunc("planes","max_full_count", 100) : 100;						// Draw no more than 100 full planes!
+// Pick the texture/object that best describes a plane's GL state, for sorting.
+static uint32_t render_state_handle(const XPMPPlanePtr plane)
+{
+	switch (plane->model->plane_type) {
+	case plane_Austin:
+		return static_cast<uint32_t>(CSL_GetOGLIndex(plane->model));
+	case plane_Obj:
+	{
+		auto tex = std::atomic_load(&plane->texHandle);
+		if (tex) { return RQ_FoldHandle(tex.get()); }
+		return RQ_FoldHandle(std::atomic_load(&plane->objHandle).get());
+	}
+	default:
+		return RQ_FoldHandle(plane->model);
+	}
+}
 
-	gTotPlanes = planeCount;
-	gNavPlanes = gACFPlanes = gOBJPlanes = 0;
+// We calculate the screen coordinates during 3D rendering
+// and actually draw the labels during 2D rendering,
+// so we need to store the coordinates somewhere:
+static std::vector<LabelInstance_t> gLabels;
+static std::vector<uint32_t> gLabelRecords;		// render record for each label
 
-	int modelCount, active, plugin;
-	XPLMCountAircraft(&modelCount, &active, &plugin);
+/************************************************************************************
+ * SIMULATION STAGE - runs in the flight loop
+ ************************************************************************************/
 
-	DistanceMap						myPlanes;		// Planes - sorted by camera distance so we can do the closest N and bail
-	DistanceMap						tcasPlanes;		// Planes - sorted by aircraft distance
+// Do we have to ask the client about this plane this cycle?  Near planes every cycle, far and
+// parked ones only every few - spread out, so they don't all come due in the same frame.
+static bool poll_plane(XPMPPlanePtr plane, int cycle, float now)
+{
+	if (plane->lastDistance > kMaxDistTCAS + kHibernateMargin)
+	{
+		if (now < plane->backgroundPoll) { return false; }
+		plane->backgroundPoll = now + kHibernateInterval;
+		return true;
+	}
+	plane->backgroundPoll = now + kHibernateInterval;		// We keep it fresh, the background refresh can leave it alone.
+
+	int interval = 1;
+	for (const auto &tier : kPollTiers)
+		if (plane->lastDistance > tier.distance)
+			interval = tier.interval;
+	if (cycle - std::max(plane->posChanged, plane->surfaceChanged) >= kParkedCycles)
+		interval = std::max(interval, kParkedPollInterval);
+
+	if (interval == 1) { return true; }
+	if (cycle < plane->nextPoll) { return false; }
+	plane->nextPoll = cycle + interval - static_cast<int>((reinterpret_cast<std::uintptr_t>(plane) / sizeof(XPMPPlane_t)) % ((interval + 1) / 2));
+	return true;
+}
 
-	/************************************************************************************
-	 * CULLING AND STATE CALCULATION LOOP
-	 ************************************************************************************/
+static void build_traffic_frame(TrafficFrame_t &frame, const FrameContext_t &context)
+{
+	frame.planeCount = XPMPCountPlanes();
+	frame.planes.clear();
+	frame.spheres.clear();
+	frame.matrices.resize(0);
+	gAttitudes.clear();
 
-	if (gDumpOneRenderCycle)
+	if (frame.planeCount == 0)		// Quick exit if no one's around.
 	{
-		XPLMDebugString("Dumping one cycle map of planes.\n");
-		char	fname[256], bigbuf[1024], foo[32];
-		for (int n = 1; n < modelCount; ++n)
-		{
-			XPLMGetNthAircraftModel(n, fname, bigbuf);
-			sprintf(foo, " [%d] - ", n);
-			XPLMDebugString(foo);
-			XPLMDebugString(fname);
-			XPLMDebugString(" - ");
-			XPLMDebugString(bigbuf);
-			XPLMDebugString("\n");
-		}
+		for (auto &ref : gMultiRefs) { ref.resetValues(); }
+		gEnableCount = 1;
+		return;
 	}
 
+	const XPLMCameraPosition_t &x_camera = context.camera;
+	const double	maxDist = context.visibility;
+
 	// Altitude for TCAS
-	const double acft_alt = XPLMGetDatad(gAltitudeRef) / kFtToMeters;
+	const double acft_alt = context.ownElevation / kFtToMeters;
 
 #if DEBUG_TCAS
 	{
-		std::string debug = "TCAS max dist " + std::to_string(kMaxDistTCAS) + " aircraft alt " + std::to_string(acft_alt) + " max " + std::to_string(MAX_TCAS_ALTDIFF) + "\n";
-		XPLMDebugString(debug.c_str());
+		char debug[256];
+		snprintf(debug, sizeof(debug), "TCAS max dist %f aircraft alt %f max %d\n", kMaxDistTCAS, acft_alt, MAX_TCAS_ALTDIFF);
+		XPLMDebugString(debug);
 	}
 #endif
 
-	// Go through every plane.  We're going to figure out if it is visible and if so remember it for drawing later.
-	for (long index = 0; index < planeCount; ++index)
+	// Only planes that can be within visibility or TCAS range are worth looking at.  The query is
+	// centered on our own plane, but has to reach as far as the camera may be away from it.
+	const double ownX = context.ownX;
+	const double ownY = context.ownY;
+	const double ownZ = context.ownZ;
+	const double cameraOffsetX = x_camera.x - ownX;
+	const double cameraOffsetY = x_camera.y - ownY;
+	const double cameraOffsetZ = x_camera.z - ownZ;
+	const double queryRadius = std::max(maxDist, kMaxDistTCAS) +
+							   sqrt(cameraOffsetX*cameraOffsetX + cameraOffsetY*cameraOffsetY + cameraOffsetZ*cameraOffsetZ);
+	gCandidates.clear();
+	SPATIAL_Query(context.ownLat, context.ownLon, queryRadius, gCandidates);
+
+	// Everyone else still gets asked for their position every now and then, so we notice them coming closer.
+	const float now = context.elapsed;
+
+	// Go through every candidate and take a snapshot of where it is.  Planes that have stayed put
+	// keep the local coordinates we worked out for them last time.
+	LOCAL_UpdateFrame();
+	const unsigned localSerial = LOCAL_FrameSerial();
+	const int cycle = context.cycle;
+	gGeoBatch.clear();
+	gGeoSnapshots.clear();
+	for (XPMPPlanePtr id : gCandidates)
 	{
-		XPMPPlaneID id = XPMPGetNthPlane(index);
-		XPMPPlanePosition_t	pos;
-		pos.size = sizeof(pos);
-		pos.label[0] = 0;
+		PlaneSnapshot_t snap;
+		snap.plane = id;
+		snap.polled = poll_plane(id, cycle, now);
+		if (snap.polled)
+		{
+			XPMPPlanePosition_t	pos;
+			pos.size = sizeof(pos);
+			pos.label[0] = 0;
+			if (XPMPGetPlaneData(id, xpmpDataType_Position, &pos) == xpmpData_Unavailable) { continue; }
+			snap.pos = pos;
+		}
+		else
+		{
+			snap.pos = id->pos;
+		}
 
-		if (XPMPGetPlaneData(id, xpmpDataType_Position, &pos) != xpmpData_Unavailable)
+		if (id->localSerial == localSerial && id->localStamp == id->posChanged)
+		{
+			snap.x = id->localX;
+			snap.y = id->localY;
+			snap.z = id->localZ;
+		}
+		else
 		{
-			// First figure out where the plane is!
+			gGeoSnapshots.push_back(static_cast<uint32_t>(frame.planes.size()));
+			gGeoBatch.push(snap.pos.lat, snap.pos.lon, snap.pos.elevation * kFtToMeters);
+		}
+		frame.planes.push_back(snap);
+	}
 
-			double	x,y,z; // other plane x y z
-			const double ownX = XPLMGetDatad(gOwnPlaneX);
-			const double ownY = XPLMGetDatad(gOwnPlaneY);
-			const double ownZ = XPLMGetDatad(gOwnPlaneZ);
+	// Then figure out where the others are!
+	LOCAL_Convert(gGeoBatch);
+	for (std::size_t n = 0; n < gGeoSnapshots.size(); ++n)
+	{
+		PlaneSnapshot_t &snap = frame.planes[gGeoSnapshots[n]];
+		snap.x = gGeoBatch.x[n];
+		snap.y = gGeoBatch.y[n];
+		snap.z = gGeoBatch.z[n];
+		snap.plane->localSerial = localSerial;
+		snap.plane->localStamp = snap.plane->posChanged;
+		snap.plane->localX = snap.x;
+		snap.plane->localY = snap.y;
+		snap.plane->localZ = snap.z;
+	}
 
-			XPLMWorldToLocal(pos.lat, pos.lon, pos.elevation * kFtToMeters, &x, &y, &z);
+	// Drop everyone outside TCAS range of both us and the camera, and ask the client for the
+	// rest of what we need from the ones that are left.
+	std::size_t kept = 0;
+	for (std::size_t index = 0; index < frame.planes.size(); ++index)
+	{
+		PlaneSnapshot_t &snap = frame.planes[index];
 
-			const double deltaOwnX = x-ownX;
-			const double deltaOwnY = y-ownY;
-			const double deltaOwnZ = z-ownZ;
+		const double deltaOwnX = snap.x-ownX;
+		const double deltaOwnY = snap.y-ownY;
+		const double deltaOwnZ = snap.z-ownZ;
+		snap.ownDist = sqrt(deltaOwnX*deltaOwnX + deltaOwnY*deltaOwnY + deltaOwnZ*deltaOwnZ);
 
-			const float cameraDistMeters = sqrt(sphere_distance_sqr(&gl_camera,
-												static_cast<float>(x), static_cast<float>(y), static_cast<float>(z)));
-			const double ownAircraftDistMeters = sqrt(deltaOwnX*deltaOwnX + deltaOwnY*deltaOwnY + deltaOwnZ*deltaOwnZ);
+		const double deltaCameraX = snap.x-x_camera.x;
+		const double deltaCameraY = snap.y-x_camera.y;
+		const double deltaCameraZ = snap.z-x_camera.z;
+		snap.cameraDist = sqrt(deltaCameraX*deltaCameraX + deltaCameraY*deltaCameraY + deltaCameraZ*deltaCameraZ);
+		snap.plane->lastDistance = static_cast<float>(std::min(snap.ownDist, snap.cameraDist));	// Picks the poll tier next time
 
-			// If the plane is farther than our TCAS range, it has no TCAS index
-			bool tcas = true;
-			if (ownAircraftDistMeters > kMaxDistTCAS) { tcas = false; static_cast<XPMPPlanePtr>(id)->tcasIndex = -1; }
-			if (!tcas && cameraDistMeters > kMaxDistTCAS) { continue; } // aircraft are not shown outside TCAS distance
+		// If the plane is farther than our TCAS range, it has no TCAS index
+		if (snap.ownDist > kMaxDistTCAS)
+		{
+			snap.plane->tcasIndex = -1;
+			if (snap.cameraDist > kMaxDistTCAS) { continue; } // aircraft are not shown outside TCAS distance
+		}
 
-			// Only draw if it's in range.
-			bool cull = (cameraDistMeters > maxDist);
-			
-			if (tcas) {
-				XPMPPlaneRadar_t radar;
-				radar.size = sizeof(radar);
-				if (XPMPGetPlaneData(id, xpmpDataType_Radar, &radar) != xpmpData_Unavailable)
-					if (radar.mode == xpmpTransponderMode_Standby) tcas = false;
+		snap.hasRadar = false;
+		if (snap.ownDist <= kMaxDistTCAS)
+		{
+			snap.radar.size = sizeof(snap.radar);
+			if (snap.polled || snap.plane->radarAge < 0)
+				snap.hasRadar = XPMPGetPlaneData(snap.plane, xpmpDataType_Radar, &snap.radar) != xpmpData_Unavailable;
+			else
+			{
+				snap.radar = snap.plane->radar;
+				snap.hasRadar = true;
+			}
+		}
+
+		snap.hasSurfaces = false;
+		if (snap.cameraDist <= kMaxDistTCAS)
+		{
+			snap.surfaces.size = sizeof(snap.surfaces);
+			if (snap.polled || snap.plane->surfaceAge < 0)
+				snap.hasSurfaces = XPMPGetPlaneData(snap.plane, xpmpDataType_Surfaces, &snap.surfaces) != xpmpData_Unavailable;
+			else
+			{
+				snap.surfaces = snap.plane->surface;
+				snap.hasSurfaces = true;
 			}
+		}
+
+		frame.spheres.push(static_cast<float>(snap.x), static_cast<float>(snap.y), static_cast<float>(snap.z), kPlaneCullRadius);
+		gAttitudes.push(snap.pos.pitch, snap.pos.roll, snap.pos.heading);
+		frame.planes[kept++] = snap;
+	}
+	frame.planes.resize(kept);
+
+	// Every plane's model matrix, once for all the passes and lights.  The culling spheres
+	// already have the positions.
+	XFORM_ModelMatrices(frame.spheres.size(), frame.spheres.x.data(), frame.spheres.y.data(), frame.spheres.z.data(),
+						gAttitudes, frame.matrices);
+
+	// From here on it's pure math, which the workers do: TCAS visibility and the draw state.
+	gWorkerPool.parallelFor(frame.planes.size(), kClassifyChunk, [&](std::size_t begin, std::size_t end, unsigned)
+	{
+		for (std::size_t index = begin; index < end; ++index)
+		{
+			PlaneSnapshot_t &snap = frame.planes[index];
+			const XPMPPlanePosition_t &pos = snap.pos;
+
+			bool tcas = (snap.ownDist <= kMaxDistTCAS);
+
+			if (tcas && snap.hasRadar && snap.radar.mode == xpmpTransponderMode_Standby) tcas = false;
 
 			// check for altitude - if difference exceeds a preconfigured limit, don't show
 			if (tcas) {
@@ -521,104 +664,129 @@ void			XPMPDefaultPlaneRenderer(int is_blend)
 				if(alt_diff < 0) alt_diff *= -1;
 				if(alt_diff > MAX_TCAS_ALTDIFF) tcas = false;
 			}
+			snap.tcas = tcas;
+			if (!tcas) { snap.plane->tcasIndex = -1; }
 
-			// Create the render record for TCAS with distance to own plane 
-			PlaneToRender_t renderRecord;
-			renderRecord.x = static_cast<float>(x);
-			renderRecord.y = static_cast<float>(y);
-			renderRecord.z = static_cast<float>(z);
-			renderRecord.plane = static_cast<XPMPPlanePtr>(id);
-			renderRecord.cull = false;
-			renderRecord.tcas = tcas; // tcas
-			if (!renderRecord.tcas) { renderRecord.plane->tcasIndex = -1; }
-            if (tcas) tcasPlanes.emplace(ownAircraftDistMeters, renderRecord);
-#if DEBUG_TCAS
-			if (tcas) {
-				char icao[128], livery[128], debug[512];
-				XPMPGetPlaneICAOAndLivery(id, icao, livery);
-				sprintf(debug,"TCAS plane %ld (%s/%s) at lle %f, %f, %f (xyz=%f, %f, %f) distance=%f\n", index, icao, livery,
-						pos.lat, pos.lon, pos.elevation, x, y, z, ownAircraftDistMeters);
-				XPLMDebugString(debug);
-			}
-#endif
-			// TCAS done here, do we need to continue
-			if (cameraDistMeters > kMaxDistTCAS) { continue; } // aircraft are not shown outside TCAS distance
+			// Only planes we may draw need a draw state.
+			if (snap.cameraDist > kMaxDistTCAS) { continue; }
 
-			// Calculate the heading from the camera to the target (hor, vert).
-			// Calculate the angles between the camera angles and the real angles.
-			// Cull if we exceed half the FOV.
-			if(!cull && !sphere_is_visible(&gl_camera, static_cast<float>(x),
-											static_cast<float>(y),
-											static_cast<float>(z), 50.0))
+			if (snap.hasSurfaces)
 			{
-				cull = true;
+				const XPMPPlaneSurfaces_t &surfaces = snap.surfaces;
+				snap.state.structSize = sizeof(snap.state);
+				snap.state.gearPosition 	= surfaces.gearPosition 	;
+				snap.state.flapRatio 		= surfaces.flapRatio 		;
+				snap.state.spoilerRatio 	= surfaces.spoilerRatio 	;
+				snap.state.speedBrakeRatio 	= surfaces.speedBrakeRatio 	;
+				snap.state.slatRatio 		= surfaces.slatRatio 		;
+				snap.state.wingSweep 		= surfaces.wingSweep 		;
+				snap.state.thrust 			= surfaces.thrust 			;
+				snap.state.yokePitch 		= surfaces.yokePitch 		;
+				snap.state.yokeHeading 		= surfaces.yokeHeading 		;
+				snap.state.yokeRoll 		= surfaces.yokeRoll 		;
+			} else {
+				snap.state.structSize = sizeof(snap.state);
+				snap.state.gearPosition = (pos.elevation < 70) ?  1.0f : 0.0f;
+				snap.state.flapRatio = (pos.elevation < 70) ? 1.0f : 0.0f;
+				snap.state.spoilerRatio = snap.state.speedBrakeRatio = snap.state.slatRatio = snap.state.wingSweep = 0.0;
+				snap.state.thrust = (pos.pitch > 30) ? 1.0f : 0.6f;
+				snap.state.yokePitch = pos.pitch / 90.0f;
+				snap.state.yokeHeading = pos.heading / 180.0f;
+				snap.state.yokeRoll = pos.roll / 90.0f;
+
+				// use some smart defaults
+				snap.plane->surface.lights.bcnLights = 1;
+				snap.plane->surface.lights.navLights = 1;
 			}
+			if (snap.plane->model && !snap.plane->model->moving_gear)
+				snap.plane->surface.gearPosition = 1.0;
+		}
+	});
 
-			// Full plane or lites based on distance.
-			const bool	drawFullPlane = (cameraDistMeters < fullPlaneDist);
-
-#if DEBUG_RENDERER
-			char	icao[128], livery[128];
-			char	debug[512];
-
-			XPMPGetPlaneICAOAndLivery(id, icao, livery);
-			sprintf(debug,"Queueing plane %d (%s/%s) at lle %f, %f, %f (xyz=%f, %f, %f) pitch=%f,roll=%f,heading=%f,model=1.\n", index, icao, livery,
-					pos.lat, pos.lon, pos.elevation,
-					x, y, z, pos.pitch, pos.roll, pos.heading);
-			XPLMDebugString(debug);
+#if XPMP_INSTANCING
+	// OBJ8 planes we can see are X-Plane's to draw - it only needs to know where they are.
+	INST_BeginFrame();
+	for (auto &snap : frame.planes)
+	{
+		if (snap.cameraDist > kMaxDistTCAS || snap.cameraDist > maxDist) { continue; }
+
+		XPLMDrawInfo_t location;
+		location.structSize = sizeof(location);
+		location.x = static_cast<float>(snap.x);
+		location.y = static_cast<float>(snap.y);
+		location.z = static_cast<float>(snap.z);
+		location.pitch = snap.pos.pitch;
+		location.roll = snap.pos.roll;
+		location.heading = snap.pos.heading;
+		snap.instanced = INST_UpdatePlane(snap.plane, location, snap.state, snap.plane->surface.lights);
+	}
+	INST_EndFrame();
 #endif
 
-			// Stash one render record with the plane's position, etc.
+	// Put the x-plane multiplayer vars in place for the TCAS-visible planes that have a slot, so
+	// they show up on our moving map.  Who gets a slot is decided by rank_tcas, a few times a second.
+	int		lastMultiRefUsed = -1;
+	std::bitset<32> written;
+	if (gHasControlOfAIAircraft)
+	{
+		for (const auto &record : frame.planes)
+		{
+			if (!record.tcas) { continue; }
+
+			// TCAS handling - if the plane needs to be drawn on TCAS and we haven't yet, move one of Austin's planes.
+			int tcasIndex = record.plane->tcasIndex;
+			if (isValidTcasIndex(tcasIndex) && static_cast<std::size_t>(tcasIndex) < written.size())
 			{
-				renderRecord.cull = cull;	// NO other planes.  Doing so causes a lot of things to go nuts!
+				const std::size_t i = static_cast<std::size_t>(tcasIndex);
+				XPLMSetDataf(gMultiRefs[i].x, static_cast<float>(record.x));
+				XPLMSetDataf(gMultiRefs[i].y, static_cast<float>(record.y));
+				XPLMSetDataf(gMultiRefs[i].z, static_cast<float>(record.z));
+				XPLMSetDataf(gMultiRefs[i].pitch, record.pos.pitch);
+				XPLMSetDataf(gMultiRefs[i].roll, record.pos.roll);
+				XPLMSetDataf(gMultiRefs[i].heading, record.pos.heading);
+				gMultiRefs[i].isReserved = true;
+				written.set(i, true);
+				if (tcasIndex > lastMultiRefUsed)
+					lastMultiRefUsed = tcasIndex;
+			}
+		}
+	}
 
-				XPMPPlaneSurfaces_t	surfaces;
-				surfaces.size = sizeof(surfaces);
-				if (XPMPGetPlaneData(id, xpmpDataType_Surfaces, &surfaces) != xpmpData_Unavailable)
-				{
-					renderRecord.state.structSize = sizeof(renderRecord.state);
-					renderRecord.state.gearPosition 	= surfaces.gearPosition 	;
-					renderRecord.state.flapRatio 		= surfaces.flapRatio 		;
-					renderRecord.state.spoilerRatio 	= surfaces.spoilerRatio 	;
-					renderRecord.state.speedBrakeRatio 	= surfaces.speedBrakeRatio 	;
-					renderRecord.state.slatRatio 		= surfaces.slatRatio 		;
-					renderRecord.state.wingSweep 		= surfaces.wingSweep 		;
-					renderRecord.state.thrust 			= surfaces.thrust 			;
-					renderRecord.state.yokePitch 		= surfaces.yokePitch 		;
-					renderRecord.state.yokeHeading 		= surfaces.yokeHeading 		;
-					renderRecord.state.yokeRoll 		= surfaces.yokeRoll 		;
-				} else {
-					renderRecord.state.structSize = sizeof(renderRecord.state);
-					renderRecord.state.gearPosition = (pos.elevation < 70) ?  1.0f : 0.0f;
-					renderRecord.state.flapRatio = (pos.elevation < 70) ? 1.0f : 0.0f;
-					renderRecord.state.spoilerRatio = renderRecord.state.speedBrakeRatio = renderRecord.state.slatRatio = renderRecord.state.wingSweep = 0.0;
-					renderRecord.state.thrust = (pos.pitch > 30) ? 1.0f : 0.6f;
-					renderRecord.state.yokePitch = pos.pitch / 90.0f;
-					renderRecord.state.yokeHeading = pos.heading / 180.0f;
-					renderRecord.state.yokeRoll = pos.roll / 90.0f;
-
-					// use some smart defaults
-					renderRecord.plane->surface.lights.bcnLights = 1;
-					renderRecord.plane->surface.lights.navLights = 1;
-				}
-				if (renderRecord.plane->model && !renderRecord.plane->model->moving_gear)
-					renderRecord.plane->surface.gearPosition = 1.0;
-				renderRecord.full = drawFullPlane;
-				renderRecord.dist = cameraDistMeters;
-				myPlanes.emplace(cameraDistMeters, renderRecord);
-
-			} // State calculation
-			
-		} // Plane has data available
-		
-	} // Per-plane loop
+	// Final hack - leave a note to ourselves for how many of Austin's planes we relocated to do TCAS.
+	gEnableCount = (lastMultiRefUsed + 2); // +1 for counter, +1 for own aircraft
+	// cleanup unused multiplayer datarefs - slots whose plane left TCAS since the last ranking too
+	if (gHasControlOfAIAircraft) {
+		for (std::size_t i = 0; i < gMultiRefs.size(); ++i) {
+			if (i >= written.size() || !written.test(i)) { gMultiRefs[i].resetValues(); }
+		}
+	}
+}
 
-	if (gDumpOneRenderCycle)
-		XPLMDebugString("End of cycle dump.\n");
+/************************************************************************************
+ * Prepare multiplayer indexes for TCAS
+ ************************************************************************************/
 
-	/************************************************************************************
-	 * Prepare multiplayer indexes for TCAS
-	 ************************************************************************************/
+// Ranks the TCAS planes by distance and hands out the multiplayer slots, closing gaps.  The slots
+// stay with their planes in between, so this doesn't have to run every frame.
+static void rank_tcas(const TrafficFrame_t &frame)
+{
+	gTcasQueue.clear();
+	for (std::size_t index = 0; index < frame.planes.size(); ++index)
+	{
+		const PlaneSnapshot_t &snap = frame.planes[index];
+		if (snap.tcas && snap.plane)
+			gTcasQueue.push(RQ_QuantizeDepth(static_cast<float>(snap.ownDist)), static_cast<uint32_t>(index));
+#if DEBUG_TCAS
+		if (snap.tcas) {
+			char icao[128], livery[128], debug[512];
+			XPMPGetPlaneICAOAndLivery(snap.plane, icao, livery);
+			sprintf(debug,"TCAS plane %zu (%s/%s) at lle %f, %f, %f (xyz=%f, %f, %f) distance=%f\n", index, icao, livery,
+					snap.pos.lat, snap.pos.lon, snap.pos.elevation, snap.x, snap.y, snap.z, snap.ownDist);
+			XPLMDebugString(debug);
+		}
+#endif
+	}
+	gTcasQueue.sort();
 
 	if (gHasControlOfAIAircraft)
 	{
@@ -627,13 +795,14 @@ void			XPMPDefaultPlaneRenderer(int is_blend)
 		// to avoid gaps in the indexes we create a vector of all indexes used and new ones
 		std::bitset<32> originalTCASIndexes; // init to 0, we never expect more than 19+1 values
 		std::size_t maxOriginalTcasIndex = 0;
-		for (auto &pair : tcasPlanes)
+		for (const auto &item : gTcasQueue)
 		{
 			if (blips >= gMultiRefs.size()) break;
-			if (pair.second.tcas)
+			const PlaneSnapshot_t &record = frame.planes[item.index];
+			if (record.tcas)
 			{
 				++blips; // should be possible to create one as we checked range already
-				int index = pair.second.plane->tcasIndex;
+				int index = record.plane->tcasIndex;
 				if (!isValidTcasIndex(index)) {
 					// if it is a new one, try to find an index
 					for (index = 0; isValidTcasIndex(index) && gMultiRefs[static_cast<size_t>(index)].isReserved; ++index)
@@ -641,7 +810,7 @@ void			XPMPDefaultPlaneRenderer(int is_blend)
 				}
 				// already used one or valid new one?
 				if (!isValidTcasIndex(index)) { continue; }
-				pair.second.plane->tcasIndex = index;
+				record.plane->tcasIndex = index;
 				const std::size_t i = static_cast<std::size_t>(index); // avoid compile issues with CLANG
 				originalTCASIndexes.set(i, true);
 				if (i > maxOriginalTcasIndex) { maxOriginalTcasIndex = i; }
@@ -667,15 +836,17 @@ void			XPMPDefaultPlaneRenderer(int is_blend)
 		// re-reserve slots already used by planes in range, from the previous frame
 #if DEBUG_TCAS
 		{
-			const std::string debug = "TCAS blips " + std::to_string(blips) + " planes " + std::to_string(tcasPlanes.size()) + "\n";
-			XPLMDebugString(debug.c_str());
+			char debug[128];
+			snprintf(debug, sizeof(debug), "TCAS blips %zu planes %zu\n", blips, gTcasQueue.size());
+			XPLMDebugString(debug);
 		}
 #endif
-		for (auto &pair : tcasPlanes)
+		for (const auto &item : gTcasQueue)
 		{
-			if (pair.second.tcas)
+			const PlaneSnapshot_t &record = frame.planes[item.index];
+			if (record.tcas)
 			{
-				int index = pair.second.plane->tcasIndex;
+				int index = record.plane->tcasIndex;
 				if (isValidTcasIndex(index)) {
 					std::size_t i = static_cast<std::size_t>(index); // avoid compile issues with CLANG
 					if (i >= blips) {
@@ -683,275 +854,646 @@ void			XPMPDefaultPlaneRenderer(int is_blend)
 							// we now close the gaps by filling them with values from the end
 							i = originalTCASIndexGaps.front(); // first free gap
 							originalTCASIndexGaps.erase(originalTCASIndexGaps.begin());
-							pair.second.plane->tcasIndex = static_cast<int>(i); // now in the free gap
+							record.plane->tcasIndex = static_cast<int>(i); // now in the free gap
 						}
 					}
 					gMultiRefs[i].isReserved = true;
 #if DEBUG_TCAS
 					{
-						const std::string debug = "Reserving index " + std::to_string(i) + " in gMultiRefs\n";
-						XPLMDebugString(debug.c_str());
+						char debug[128];
+						snprintf(debug, sizeof(debug), "Reserving index %zu in gMultiRefs\n", i);
+						XPLMDebugString(debug);
 					}
 #endif
 				}
 			} // TCAS
 		} // for planes
 	}	// gHasControlOfAIAircraft
+}
+
+static void init_tasks()
+{
+	gFlightLoopTasks.clear();
+	gDrawTasks.clear();
+
+	// TCAS slots stick with their planes, so a few re-rankings a second are plenty.
+	gFlightLoopTasks.add(kTcasRankHz, [](TaskScheduler::Clock::time_point)
+	{
+		rank_tcas(gTrafficFrames[gDrawFrame]);
+		return true;
+	});
+
+	// Hibernating planes, a chunk at a time until none are due, the cap is reached or time is up.
+	// The spatial index remembers where it stopped.
+	gFlightLoopTasks.add(0.0f, [](TaskScheduler::Clock::time_point deadline)
+	{
+		const std::size_t cap = static_cast<std::size_t>(static_cast<int>(gPrefs.backgroundRefreshCount));
+		const float now = FRAME_Begin().elapsed;
+		for (std::size_t polled = 0; polled < cap; )
+		{
+			const std::size_t chunk = std::min(kBackgroundChunk, cap - polled);
+			const std::size_t n = SPATIAL_RefreshBackground(chunk, now);
+			polled += n;
+			if (n < chunk) { return true; }
+			if (TaskScheduler::Clock::now() >= deadline) { return false; }
+		}
+		return true;
+	});
+
+	// Prefs only change when the user changes them, and then it's fine if it takes a moment.
+	gFlightLoopTasks.add(kPrefsRefreshHz, [](TaskScheduler::Clock::time_point)
+	{
+		PREFS_Refresh();
+		return true;
+	});
+
+	gDrawTasks.add(kTextureMaintenanceHz, [](TaskScheduler::Clock::time_point)
+	{
+		OBJ_MaintainTextures();
+		return true;
+	});
+}
+
+float			XPMPDefaultPlaneRendererFlightLoop(float, float, int, void *)
+{
+	// A custom renderer gets no help from us.
+	if (!gRenderer)
+	{
+		GOV_EndFrame();
+		ALLOC_EndFrame(gSteadyFrames >= kSteadyFrames);
+		gSavedStateChanges = OGL_TakeSavedStateChanges();	// Summed over every pass and view of the frame that just ended
+		GOV_BeginCpu();
+		const int next = 1 - gDrawFrame;
+		gTrafficFrames[next].serial = gTrafficFrames[gDrawFrame].serial + 1;
+		build_traffic_frame(gTrafficFrames[next], FRAME_Begin());
+		gSteadyFrames = (gTrafficFrames[next].planes.size() == gTrafficFrames[gDrawFrame].planes.size()) ? gSteadyFrames + 1 : 0;
+		gDrawFrame = next;
+		gFlightLoopTasks.run(gPrefs.taskBudgetMs);
+		GOV_EndCpu();
+	}
+	return -1.0f;
+}
+
+void			XPMPDefaultPlaneRendererForgetPlane(XPMPPlaneID inPlane)
+{
+#if XPMP_INSTANCING
+	INST_ForgetPlane(static_cast<XPMPPlanePtr>(inPlane));
+#endif
+	for (auto &frame : gTrafficFrames)
+		for (auto &snap : frame.planes)
+			if (snap.plane == inPlane)
+				snap.plane = nullptr;
+}
+
+/************************************************************************************
+ * RENDER STAGE - runs in the draw callback
+ ************************************************************************************/
+
+// Picks the detail for one plane from the size of its bounding sphere on screen.
+static void choose_lod(PlaneToRender_t &record, const cull_info_t &gl_camera, float halfViewportHeight, float fullPixels)
+{
+	const float * mv = gl_camera.model_view;
+	const float * proj = gl_camera.proj;
+	const float xe = record.x * mv[0] + record.y * mv[4] + record.z * mv[ 8] + mv[12];
+	const float ye = record.x * mv[1] + record.y * mv[5] + record.z * mv[ 9] + mv[13];
+	const float ze = record.x * mv[2] + record.y * mv[6] + record.z * mv[10] + mv[14];
+
+	// w is the depth for a perspective projection and 1 for an orthographic one.
+	const float w = std::max(xe * proj[3] + ye * proj[7] + ze * proj[11] + proj[15], 1.0f);
+	const float pixels = kPlaneCullRadius * proj[5] * halfViewportHeight / w;
+
+	record.full = (pixels >= fullPixels);
+	record.dot = (pixels < kDotPixels);
+	record.lodDist = kPlaneCullRadius * kRefPixelsPerRadian / std::max(pixels, 0.001f);
+}
+
+// Builds the view's render records and distance queue for a new frame, with distances measured from eye.
+// Only the main view keeps frustum tests from frame to frame - shadow views test every plane.
+static void classify_planes(RenderView_t &view, const TrafficFrame_t &frame, const cull_info_t &gl_camera, const float eye[3],
+							bool is_shadow, int modelCount, double maxDist, float halfViewportHeight, float fullPixels)
+{
+	view.records.clear();
+	view.distanceQueue.clear();
+	memcpy(view.eye, eye, sizeof(view.eye));
+
+	if (gDumpOneRenderCycle)
+	{
+		XPLMDebugString("Dumping one cycle map of planes.\n");
+		char	fname[256], bigbuf[1024], foo[32];
+		for (int n = 1; n < modelCount; ++n)
+		{
+			XPLMGetNthAircraftModel(n, fname, bigbuf);
+			sprintf(foo, " [%d] - ", n);
+			XPLMDebugString(foo);
+			XPLMDebugString(fname);
+			XPLMDebugString(" - ");
+			XPLMDebugString(bigbuf);
+			XPLMDebugString("\n");
+		}
+	}
+
+	// See how far the camera moved since the last frame.  A shadow view in between would look
+	// like a new projection every time, and start a new epoch every frame.
+	const bool coherent = !is_shadow;
+	if (!coherent)
+	{
+		// Nothing to keep track of.
+	}
+	else if (gCoherence.epoch == 0 || memcmp(gCoherence.view.proj, gl_camera.proj, sizeof(gl_camera.proj)) != 0 ||
+		gCoherence.move > kCoherenceMaxMove)
+	{
+		++gCoherence.epoch;
+		gCoherence.move = 0.0f;
+		gCoherence.turn = 0.0f;
+	}
+	else
+	{
+		float from[3], to[3];
+		CULL_EyePosition(&gCoherence.view, from);
+		CULL_EyePosition(&gl_camera, to);
+		gCoherence.move += sqrtf((to[0]-from[0])*(to[0]-from[0]) + (to[1]-from[1])*(to[1]-from[1]) + (to[2]-from[2])*(to[2]-from[2]));
+		gCoherence.turn += CULL_ViewTurn(&gCoherence.view, &gl_camera);
+	}
+	if (coherent)
+		gCoherence.view = gl_camera;
+
+	// Only planes that may have crossed a frustum plane since their last test are tested again, in one batch.
+	gDirtySpheres.clear();
+	gDirtyPlanes.clear();
+	gEyeDistance.resize(frame.planes.size());
+	for (std::size_t index = 0; index < frame.planes.size(); ++index)
+	{
+		const PlaneSnapshot_t &snap = frame.planes[index];
+		if (!snap.plane || snap.cameraDist > kMaxDistTCAS) { continue; }
+		const XPMPPlanePtr plane = snap.plane;
+
+		const float x = frame.spheres.x[index];
+		const float y = frame.spheres.y[index];
+		const float z = frame.spheres.z[index];
+		const float dist = sqrtf((x-eye[0])*(x-eye[0]) + (y-eye[1])*(y-eye[1]) + (z-eye[2])*(z-eye[2]));
+		gEyeDistance[index] = dist;
+		if (!coherent) { continue; }
+
+		const float planeMove = sqrtf((x-plane->cullX)*(x-plane->cullX) + (y-plane->cullY)*(y-plane->cullY) + (z-plane->cullZ)*(z-plane->cullZ));
+		const float drift = planeMove + (gCoherence.move - plane->cullMove) + (gCoherence.turn - plane->cullTurn) * dist;
+		if (plane->cullEpoch != gCoherence.epoch || drift >= fabsf(plane->cullMargin))
+		{
+			gDirtySpheres.push(x, y, z, frame.spheres.r[index]);
+			gDirtyPlanes.push_back(static_cast<uint32_t>(index));
+		}
+	}
+
+	if (!coherent)
+		CULL_Spheres(&gl_camera, frame.spheres, gViewCullResults);
+	else
+	{
+		CULL_Spheres(&gl_camera, gDirtySpheres, gCullResults);
+		for (std::size_t n = 0; n < gDirtyPlanes.size(); ++n)
+		{
+			const XPMPPlanePtr plane = frame.planes[gDirtyPlanes[n]].plane;
+			plane->cullEpoch = gCoherence.epoch;
+			plane->cullX = gDirtySpheres.x[n];
+			plane->cullY = gDirtySpheres.y[n];
+			plane->cullZ = gDirtySpheres.z[n];
+			plane->cullMove = gCoherence.move;
+			plane->cullTurn = gCoherence.turn;
+			plane->cullMargin = gCullResults.margin[n];
+			plane->cullVisible = gCullResults.isVisible(n);
+		}
+	}
+
+	// Now go through every plane in the frame.  We're going to figure out if it is visible and if so remember it for drawing later.
+	// This runs on the worker pool: each worker classifies a chunk of planes into its own list, and we merge them afterwards.
+	gClassified.resize(gWorkerPool.workerCount());
+	for (auto &list : gClassified) { list.clear(); }
+
+	gWorkerPool.parallelFor(frame.planes.size(), kClassifyChunk, [&](std::size_t begin, std::size_t end, unsigned worker)
+	{
+		std::vector<PlaneToRender_t> &out = gClassified[worker];
+		for (std::size_t index = begin; index < end; ++index)
+		{
+			const PlaneSnapshot_t &snap = frame.planes[index];
+			// Skip destroyed planes, and the ones the flight loop didn't prepare for drawing.
+			if (!snap.plane || snap.cameraDist > kMaxDistTCAS) { continue; }
+
+			const float cameraDistMeters = gEyeDistance[index];
+			if (cameraDistMeters > kMaxDistTCAS) { continue; } // aircraft are not shown outside TCAS distance
+
+			// Only draw if it's in range, and cull if we are outside the view frustum.
+			const bool visible = coherent ? snap.plane->cullVisible : gViewCullResults.isVisible(index);
+			const bool cull = (cameraDistMeters > maxDist) || !visible;
+
+			// Stash one render record with the plane's position, etc.
+			PlaneToRender_t renderRecord;
+			renderRecord.x = static_cast<float>(snap.x);
+			renderRecord.y = static_cast<float>(snap.y);
+			renderRecord.z = static_cast<float>(snap.z);
+			renderRecord.plane = snap.plane;
+			renderRecord.cull = cull;	// NO other planes.  Doing so causes a lot of things to go nuts!
+			choose_lod(renderRecord, gl_camera, halfViewportHeight, fullPixels);	// Full plane, lites or just a dot based on screen size.
+			renderRecord.state = snap.state;
+			renderRecord.dist = cameraDistMeters;
+			renderRecord.snapshot = static_cast<uint32_t>(index);
+			renderRecord.impostor = -1;
+			out.push_back(renderRecord);
+		}
+	});
+
+	// Merge the workers' lists into the render records and queue them up.
+	for (const auto &list : gClassified)
+	{
+		for (const auto &record : list)
+		{
+			view.distanceQueue.push(RQ_QuantizeDepth(record.dist), static_cast<uint32_t>(view.records.size()));
+			view.records.push_back(record);
+#if DEBUG_RENDERER
+			char	icao[128], livery[128];
+			char	debug[512];
+
+			XPMPGetPlaneICAOAndLivery(record.plane, icao, livery);
+			sprintf(debug,"Queueing plane (%s/%s) at lle %f, %f, %f (xyz=%f, %f, %f) pitch=%f,roll=%f,heading=%f,model=1.\n", icao, livery,
+					record.plane->pos.lat, record.plane->pos.lon, record.plane->pos.elevation,
+					record.x, record.y, record.z, record.plane->pos.pitch, record.plane->pos.roll, record.plane->pos.heading);
+			XPLMDebugString(debug);
+#endif
+		}
+	}
+
+	if (gDumpOneRenderCycle)
+		XPLMDebugString("End of cycle dump.\n");
+
+	view.distanceQueue.sort();
+}
+
+// Lets the allocation check know when our scratch space had to grow - see XPMPAllocations.
+static void note_capacities(const RenderView_t &view)
+{
+	ALLOC_NoteCapacity(view.records);
+	ALLOC_NoteCapacity(view.distanceQueue);
+	ALLOC_NoteCapacity(gClassified);
+	for (const auto &list : gClassified)
+		ALLOC_NoteCapacity(list);
+	ALLOC_NoteCapacity(gDirtySpheres);
+	ALLOC_NoteCapacity(gDirtyPlanes);
+	ALLOC_NoteCapacity(gEyeDistance);
+	ALLOC_NoteCapacity(gCullResults);
+	ALLOC_NoteCapacity(gViewCullResults);
+	ALLOC_NoteCapacity(gDrawQueue);
+	ALLOC_NoteCapacity(gImpostors);
+	ALLOC_NoteCapacity(gLabels);
+	ALLOC_NoteCapacity(gLabelRecords);
+}
+
+// One pass over the planes.  Shadow passes draw only the closest planes, at their lowest LOD,
+// without lights and labels.
+static void		render_planes(const FrameContext_t &context, int is_blend, bool is_shadow)
+{
+	const TrafficFrame_t &frame = gTrafficFrames[gDrawFrame];
+#if DEBUG_RENDERER
+	char	buf[50];
+	sprintf(buf,"Renderer Planes: %ld\n", frame.planeCount);
+	XPLMDebugString(buf);
+#endif
+	if (frame.planes.empty())		// Quick exit if no one's around.
+	{
+		gLabels.clear();
+		if (gDumpOneRenderCycle)
+		{
+			gDumpOneRenderCycle = false;
+			XPLMDebugString("No planes this cycle.\n");
+		}
+		return;
+	}
+
+	const cull_info_t			&gl_camera = context.view;
+	const XPLMCameraPosition_t	&x_camera = context.camera;	// only for zoom!
+
+	// Culling - read the camera pos«and figure out what's visible.
+
+	const double	maxDist = context.visibility;
+	const double	labelDist = std::min(maxDist, MAX_LABEL_DIST) * x_camera.zoom;		// Labels get easier to see when users zooms.
+	// The governor scales all the budgets down when we run out of frame time.
+	const float		detail = GOV_Detail();
+	const double	fullPlaneDist = (5280.0 / 3.2) * gPrefs.fullDistance * detail;	// Only draw planes fully within 3 miles (in the reference view).
+	const float		fullPixels = static_cast<float>(kPlaneCullRadius * kRefPixelsPerRadian / fullPlaneDist);
+	const int		maxFullPlanes = static_cast<int>(gPrefs.maxFullCount * detail);			// Draw no more than 100 full planes!
+	const int		maxShadowCasters = static_cast<int>(gPrefs.maxShadowCount * detail);		// Only the closest 50 planes cast shadows.
+	const bool		dotLights = detail >= kGovernorDotLights;
+	const bool		useImpostors = !is_shadow && gPrefs.impostors &&
+								   !context.night;	// Far planes as baked sprites - by day, they are baked without lights.
+
+	gTotPlanes = frame.planeCount;
+	gNavPlanes = gACFPlanes = gOBJPlanes = 0;
+
+	int modelCount, active, plugin;
+	XPLMCountAircraft(&modelCount, &active, &plugin);
+
+	const float		halfViewportHeight = 0.5f * static_cast<float>(context.viewport[3]);
+
+	/************************************************************************************
+	 * CULLING AND LOD LOOP
+	 ************************************************************************************/
+
+	RenderView_t &view = is_shadow ? gShadowView : gMainView;
+
+	// The shadow view's eye is the sun - distances that matter for it are the ones to the camera.
+	float eye[3];
+	if (is_shadow)
+	{
+		eye[0] = x_camera.x;
+		eye[1] = x_camera.y;
+		eye[2] = x_camera.z;
+	}
+	else
+		CULL_EyePosition(&gl_camera, eye);
+
+	const int cycle = context.cycle;
+	const bool sameFrame = (view.cycle == cycle && view.frameSerial == frame.serial);
+	const bool sameEye = sameFrame && memcmp(view.eye, eye, sizeof(eye)) == 0;
+	const bool sameView = sameEye &&
+						  memcmp(view.model_view, gl_camera.model_view, sizeof(gl_camera.model_view)) == 0 &&
+						  memcmp(view.proj, gl_camera.proj, sizeof(gl_camera.proj)) == 0;
+	view.cycle = cycle;
+	view.frameSerial = frame.serial;
+	memcpy(view.model_view, gl_camera.model_view, sizeof(gl_camera.model_view));
+	memcpy(view.proj, gl_camera.proj, sizeof(gl_camera.proj));
+
+	if (sameView)
+	{
+		// Nothing to do - the records are exactly what the last pass left.
+	}
+	else if (sameFrame)
+	{
+		// Another view of the same frame: cull again.  If the eye moved too - the other eye in
+		// VR - measure and sort again, so budgets, LODs and labels go by this eye.
+		CULL_Spheres(&gl_camera, frame.spheres, gViewCullResults);
+		if (!sameEye)
+		{
+			memcpy(view.eye, eye, sizeof(view.eye));
+			view.distanceQueue.clear();
+		}
+		for (std::size_t index = 0; index < view.records.size(); ++index)
+		{
+			PlaneToRender_t &record = view.records[index];
+			if (!sameEye)
+			{
+				const float dx = frame.spheres.x[record.snapshot] - eye[0];
+				const float dy = frame.spheres.y[record.snapshot] - eye[1];
+				const float dz = frame.spheres.z[record.snapshot] - eye[2];
+				record.dist = sqrtf(dx*dx + dy*dy + dz*dz);
+				view.distanceQueue.push(RQ_QuantizeDepth(record.dist), static_cast<uint32_t>(index));
+			}
+			record.cull = (record.dist > maxDist) || !gViewCullResults.isVisible(record.snapshot);
+			choose_lod(record, gl_camera, halfViewportHeight, fullPixels);
+		}
+		if (!sameEye)
+			view.distanceQueue.sort();
+	}
+	else
+	{
+		classify_planes(view, frame, gl_camera, eye, is_shadow, modelCount, maxDist, halfViewportHeight, fullPixels);
+	}
 
 	/************************************************************************************
 	 * ACTUAL RENDERING LOOP
 	 ************************************************************************************/
 
 	// We're going to go in and render the first N planes in full, and the rest as lites.
-	// We're also going to put the x-plane multiplayer vars in place for the first N
-	// TCAS-visible planes, so they show up on our moving map.
-	// We do this in two stages: building up what to do, then doing it in the optimal
+	// We do this in two stages: filling the draw queue, then draining it in the optimal
 	// OGL order.
 
-	size_t	renderedCounter = 0;
-	int		lastMultiRefUsed = -1;
-
-	std::vector<PlaneToRender_t *>			planes_obj_lites;
-	std::multimap<int, PlaneToRender_t *>	planes_austin;
-	std::vector<PlaneToRender_t *>			planes_obj;
-	std::vector<PlaneToRender_t *>			planes_obj8;
+	int		fullPlanes = 0;
+	int		shadowCasters = 0;
 
-	std::vector<PlaneToRender_t *>::iterator		planeIter;
-	std::multimap<int, PlaneToRender_t *>::iterator	planeMapIter;
+	gDrawQueue.clear();
+	gImpostors.clear();
 
-	// In our first iteration pass we'll go through all planes and handle TCAS, draw planes that have no
-	// CSL model, and put CSL planes in the right 'bucket'.
+	// In our first iteration pass we'll go through all planes and queue
+	// everything that needs drawing in this pass.
 
-	for (DistanceMap::iterator iter = myPlanes.begin(); iter != myPlanes.end(); ++iter)
+	for (const auto &item : view.distanceQueue)
 	{
+		const uint32_t index = item.index;
+		PlaneToRender_t &record = view.records[index];
+
 		// This is the case where we draw a real plane.
-		if (!iter->second.cull)
+		if (!record.cull)
 		{
-			// Max plane enforcement - once we run out of the max number of full planes the
-			// user allows, force only lites for framerate
-			if (gACFPlanes >= maxFullPlanes)
-				iter->second.full = false;
+			// A dot is nothing but its lights - and those are the first thing to go when we're short on time.
+			if (record.dot && !dotLights)
+				continue;
+
+			if (is_shadow)
+			{
+				// The queue is sorted by distance, so once we have enough casters we can bail.
+				if (shadowCasters >= maxShadowCasters)
+					break;
+				++shadowCasters;
+			}
+			else
+			{
+				// Max plane enforcement - once we run out of the max number of full planes the
+				// user allows, force only lites for framerate
+				if (fullPlanes >= maxFullPlanes)
+					record.full = false;
+				if (record.full)
+					++fullPlanes;
+			}
 
 #if DEBUG_RENDERER
 			char	debug[512];
 			sprintf(debug,"Drawing plane: %s at %f,%f,%f (%fx%fx%f full=%d\n",
-					iter->second.plane->model ? iter->second.plane->model->file_path.c_str() : "<none>", iter->second.x, iter->second.y, iter->second.z,
-					iter->second.plane->pos.pitch, iter->second.plane->pos.roll, iter->second.plane->pos.heading, iter->second.full ? 1 : 0);
+					record.plane->model ? record.plane->model->file_path.c_str() : "<none>", record.x, record.y, record.z,
+					record.plane->pos.pitch, record.plane->pos.roll, record.plane->pos.heading, record.full ? 1 : 0);
 			XPLMDebugString(debug);
 #endif
 
-			if (iter->second.plane->model)
+			if (record.plane->model)
 			{
 				// Fixme:
 				// find or update the actual vert offset in the csl model data
-				// cslVertOffsetCalc.findOrUpdateActualVertOffset(*iter->second.plane->model);
+				// cslVertOffsetCalc.findOrUpdateActualVertOffset(*record.plane->model);
 				// correct y value by real terrain elevation
 				// const bool isClampingOn = gIntPrefsFunc("PREFERENCES", "CLAMPING", 0);
-				// iter->second.y = static_cast<float>(getCorrectYValue(iter->second.x, iter->second.y, iter->second.z, iter->second.plane->model->actualVertOffset, isClampingOn));
-				if (iter->second.plane->model->plane_type == plane_Austin)
+				// record.y = static_cast<float>(getCorrectYValue(record.x, record.y, record.z, record.plane->model->actualVertOffset, isClampingOn));
+				// X-Plane draws this one by itself.
+				if (frame.planes[record.snapshot].instanced)
+					continue;
+
+				const int type = record.plane->model->plane_type;
+				const uint32_t state = render_state_handle(record.plane);
+
+				// Planes in between full and dot size can be an impostor instead.  The solid pass
+				// decides, the blend pass goes along with it.
+				if (!is_blend)
+					record.impostor = (useImpostors && !record.full && !record.dot && (type == plane_Obj || type == plane_Obj8)) ? IMP_Request(record.plane) : -1;
+				if (record.impostor >= 0 && !is_blend)
+				{
+					gImpostors.push_back({ record.x, record.y, record.z, record.plane->pos.heading, record.impostor });
+					continue;
+				}
+
+				if (type == plane_Austin)
 				{
-					planes_austin.insert(std::multimap<int, PlaneToRender_t *>::value_type(CSL_GetOGLIndex(iter->second.plane->model), &iter->second));
+					if (gHasControlOfAIAircraft && !is_blend)
+						gDrawQueue.push(RQ_MakeKey(rq_pass_Austin, plane_Austin, state, record.dist, false), index);
 				}
-				else if (iter->second.plane->model->plane_type == plane_Obj)
+				else if (type == plane_Obj)
 				{
-					planes_obj.push_back(&iter->second);
-					planes_obj_lites.push_back(&iter->second);
+					if (is_blend)
+					{
+						if (!record.dot && record.impostor < 0)
+							gDrawQueue.push(RQ_MakeKey(rq_pass_Obj, plane_Obj, state, record.dist, false), index);
+						gDrawQueue.push(RQ_MakeKey(rq_pass_Lights, plane_Lights, 0, record.dist, false), index);
+					}
 				}
-				else if(iter->second.plane->model->plane_type == plane_Obj8)
+				else if (type == plane_Obj8)
 				{
-					planes_obj8.push_back(&iter->second);
+					if (is_blend)
+					{
+						// Glass only matters up close.
+						if (record.full)
+							gDrawQueue.push(RQ_MakeKey(rq_pass_Obj8_Glass, plane_Obj8_Transparent, state, record.dist, true), index);
+					}
+					else
+						gDrawQueue.push(RQ_MakeKey(rq_pass_Obj8_Solid, is_shadow ? plane_Obj8_Shadow : plane_Obj8, state, record.dist, false), index);
 				}
 
-			} else {
+			} else if (!is_blend) {
 				// If it's time to draw austin's planes but this one
 				// doesn't have a model, we draw anything.
-				glMatrixMode(GL_MODELVIEW);
-				glPushMatrix();
-				glTranslatef(iter->second.x, iter->second.y, iter->second.z);
-				glRotatef(iter->second.plane->pos.heading, 0.0, -1.0, 0.0);
-				glRotatef(iter->second.plane->pos.pitch, -1.0, 0.0, 0.0);
-				glRotatef(iter->second.plane->pos.roll, 0.0, 0.0, -1.0);
-
-				// Safety check - if plane 1 isn't even loaded do NOT draw, do NOT draw plane 0.
-				// Using the user's planes can cause the internal flight model to get f-cked up.
-				// Using a non-loaded plane can trigger internal asserts in x-plane.
-				if (modelCount > 1)
-					if(!is_blend)
-						XPLMDrawAircraft(1,
-											static_cast<float>(iter->second.x), static_cast<float>(iter->second.y), static_cast<float>(iter->second.z),
-											iter->second.plane->pos.pitch, iter->second.plane->pos.roll, iter->second.plane->pos.heading,
-											iter->second.full ? 1 : 0, &iter->second.state);
-
-				glPopMatrix();
+				gDrawQueue.push(RQ_MakeKey(rq_pass_NoModel, plane_Austin, 0, record.dist, false), index);
 			}
 
 		}
+	}
 
-		// TCAS handling - if the plane needs to be drawn on TCAS and we haven't yet, move one of Austin's planes.
-		if (iter->second.tcas && renderedCounter < gMultiRefs.size() && gHasControlOfAIAircraft)
+	gDrawQueue.sort();
+
+	// Now drain the queue.  It comes out pass by pass:
+	// PASS 0 - planes without a model, drawn with the user's plane.
+	// PASS 1 - draw Austin's planes, grouped by model.
+	// PASS 2 - draw solid OBJ8s, front to back.  Attachments without animation are batched and drawn
+	//	for all planes at once when the pass ends.
+	// PASS 3 - draw OBJ7s.
+	//	Blend for solid OBJ7s?  YES!  First, in HDR mode, they DO NOT draw to the gbuffer properly -
+	//	they splat their livery into the normal map, which is terrifying and stupid.  Then they are also
+	//	pre-lit...the net result is surprisingly not much worse than regular rendering considering how many
+	//	bad things have happened, but for all I know we're getting NaNs somewhere.
+	//
+	//	Blending isn't going to hurt things in NON-HDR because our rendering is so stupid for old objs - there's
+	//	pretty much never translucency so we aren't going to get Z-order fails.  So f--- it...always draw blend.
+	// PASS 4 - draw OBJ lights.  They are collected plane by plane and drawn all at once when the pass ends.
+	// PASS 5 - draw translucent OBJ8s, back to front.
+	// The state cache only sees our own OBJ7 and light state, so it starts over with every pass.
+	bool lightsBegun = false;
+	unsigned lastPass = rq_pass_Count;
+	for (const auto &item : gDrawQueue)
+	{
+		PlaneToRender_t &record = view.records[item.index];
+		const unsigned pass = RQ_KeyPass(item.key);
+		if (pass != lastPass)
 		{
-			int index = iter->second.plane->tcasIndex;
-			if (isValidTcasIndex(index))
-			{
-				const std::size_t i = static_cast<std::size_t>(index);
-				XPLMSetDataf(gMultiRefs[i].x, iter->second.x);
-				XPLMSetDataf(gMultiRefs[i].y, iter->second.y);
-				XPLMSetDataf(gMultiRefs[i].z, iter->second.z);
-				XPLMSetDataf(gMultiRefs[i].pitch, iter->second.plane->pos.pitch);
-				XPLMSetDataf(gMultiRefs[i].roll, iter->second.plane->pos.roll);
-				XPLMSetDataf(gMultiRefs[i].heading, iter->second.plane->pos.heading);
-				gMultiRefs[i].isReserved = true;
-				iter->second.plane->tcasIndex = index;
-				if (index > lastMultiRefUsed)
-					lastMultiRefUsed = index;
-				++renderedCounter;
-			}
+			if (lastPass == rq_pass_Obj8_Solid)
+				OBJ8_EndBatch();
+			if (lastPass == rq_pass_Lights)
+				OBJ_EndLightDrawing();
+			OGL_ResetStateCache();
+			if (pass == rq_pass_Obj8_Solid)
+				OBJ8_BeginBatch();
+			lastPass = pass;
 		}
-	}
+		int type = plane_Obj8;
+		switch (pass) {
+		case rq_pass_NoModel:
+			glMatrixMode(GL_MODELVIEW);
+			glPushMatrix();
+			glTranslatef(record.x, record.y, record.z);
+			glRotatef(record.plane->pos.heading, 0.0, -1.0, 0.0);
+			glRotatef(record.plane->pos.pitch, -1.0, 0.0, 0.0);
+			glRotatef(record.plane->pos.roll, 0.0, 0.0, -1.0);
+
+			// Safety check - if plane 1 isn't even loaded do NOT draw, do NOT draw plane 0.
+			// Using the user's planes can cause the internal flight model to get f-cked up.
+			// Using a non-loaded plane can trigger internal asserts in x-plane.
+			if (modelCount > 1)
+				XPLMDrawAircraft(1,
+								 record.x, record.y, record.z,
+								 record.plane->pos.pitch, record.plane->pos.roll, record.plane->pos.heading,
+								 (record.full && !is_shadow) ? 1 : 0, &record.state);
 
-	// PASS 1 - draw Austin's planes.
-	if(gHasControlOfAIAircraft && !is_blend)
-		for (planeMapIter = planes_austin.begin(); planeMapIter != planes_austin.end(); ++planeMapIter)
-		{
-			CSL_DrawObject(	planeMapIter->second->plane,
-							planeMapIter->second->dist,
-							planeMapIter->second->x,
-							planeMapIter->second->y,
-							planeMapIter->second->z,
-							planeMapIter->second->plane->pos.pitch,
-							planeMapIter->second->plane->pos.roll,
-							planeMapIter->second->plane->pos.heading,
-							plane_Austin,
-							planeMapIter->second->full ? 1 : 0,
-							planeMapIter->second->plane->surface.lights,
-							&planeMapIter->second->state);
-
-			if (planeMapIter->second->full)
+			glPopMatrix();
+			continue;
+		case rq_pass_Austin:
+			type = plane_Austin;
+			if (record.full)
 				++gACFPlanes;
 			else
 				++gNavPlanes;
-		}
-
-	// PASS 2 - draw OBJs
-	// Blend for solid OBJ7s?  YES!  First, in HDR mode, they DO NOT draw to the gbuffer properly -
-	// they splat their livery into the normal map, which is terrifying and stupid.  Then they are also
-	// pre-lit...the net result is surprisingly not much worse than regular rendering considering how many
-	// bad things have happened, but for all I know we're getting NaNs somewhere.
-	//
-	// Blending isn't going to hurt things in NON-HDR because our rendering is so stupid for old objs - there's
-	// pretty much never translucency so we aren't going to get Z-order fails.  So f--- it...always draw blend.<
-	if(is_blend)
-		for (const auto &plane_obj : planes_obj)
-		{
-			CSL_DrawObject(
-						plane_obj->plane,
-						plane_obj->dist,
-						plane_obj->x,
-						plane_obj->y,
-						plane_obj->z,
-						plane_obj->plane->pos.pitch,
-						plane_obj->plane->pos.roll,
-						plane_obj->plane->pos.heading,
-						plane_Obj,
-						plane_obj->full ? 1 : 0,
-						plane_obj->plane->surface.lights,
-						&plane_obj->state);
+			break;
+		case rq_pass_Obj8_Solid:
+			type = is_shadow ? plane_Obj8_Shadow : plane_Obj8;
+			break;
+		case rq_pass_Obj:
+			type = plane_Obj;
 			++gOBJPlanes;
-		}
-
-	if (!is_blend)
-	{
-		for (planeIter = planes_obj8.begin(); planeIter != planes_obj8.end(); ++planeIter)
-		{
-			CSL_DrawObject((*planeIter)->plane,
-				(*planeIter)->dist,
-				(*planeIter)->x,
-				(*planeIter)->y,
-				(*planeIter)->z,
-				(*planeIter)->plane->pos.pitch,
-				(*planeIter)->plane->pos.roll,
-				(*planeIter)->plane->pos.heading,
-				plane_Obj8,
-				(*planeIter)->full ? 1 : 0,
-				(*planeIter)->plane->surface.lights,
-				&(*planeIter)->state);
-		}
-	}
-
-	// PASS 3 - draw OBJ lights.
-	if(is_blend)
-	{
-		if (!planes_obj_lites.empty())
-		{
-			OBJ_BeginLightDrawing();
-			for (planeIter = planes_obj_lites.begin(); planeIter != planes_obj_lites.end(); ++planeIter)
+			break;
+		case rq_pass_Lights:
+			type = plane_Lights;
+			if (!lightsBegun)
 			{
-				// this thing draws the lights of a model
-				CSL_DrawObject( (*planeIter)->plane,
-								(*planeIter)->dist,
-								(*planeIter)->x,
-								(*planeIter)->y,
-								(*planeIter)->z,
-								(*planeIter)->plane->pos.pitch,
-								(*planeIter)->plane->pos.roll,
-								(*planeIter)->plane->pos.heading,
-								plane_Lights,
-								(*planeIter)->full ? 1 : 0,
-								(*planeIter)->plane->surface.lights,
-								&(*planeIter)->state);
+				OBJ_BeginLightDrawing(context);
+				lightsBegun = true;
 			}
+			break;
+		case rq_pass_Obj8_Glass:
+			type = plane_Obj8_Transparent;
+			break;
 		}
-	}
 
-	// PASS 4 - draw translucent
-	if(is_blend)
+		// OBJ7 LODs are picked by how far away the plane looks, its lights by how far away it is.
+		int lod = record.dot ? lod_Dot : (record.full ? lod_Full : lod_Lites);
+		if (is_shadow)
+			lod = lod_Lites;
+		CSL_DrawObject(	record.plane,
+						type == plane_Obj ? record.lodDist : record.dist,
+						record.x,
+						record.y,
+						record.z,
+						record.plane->pos.pitch,
+						record.plane->pos.roll,
+						record.plane->pos.heading,
+						type,
+						lod,
+						record.plane->surface.lights,
+						&record.state,
+						frame.matrices[record.snapshot],
+						context);
+	}
+	if (lastPass == rq_pass_Obj8_Solid)
+		OBJ8_EndBatch();
+	if (lastPass == rq_pass_Lights)
+		OBJ_EndLightDrawing();
+
+	// Impostors go in with the solid planes, all in one go.  Then bake a few more views for
+	// the planes that are still waiting for theirs.
+	if (!is_blend && useImpostors)
 	{
-		for (planeIter = planes_obj8.begin(); planeIter != planes_obj8.end(); ++planeIter)
-		{
-			CSL_DrawObject((*planeIter)->plane,
-				(*planeIter)->dist,
-				(*planeIter)->x,
-				(*planeIter)->y,
-				(*planeIter)->z,
-				(*planeIter)->plane->pos.pitch,
-				(*planeIter)->plane->pos.roll,
-				(*planeIter)->plane->pos.heading,
-				plane_Obj8_Transparent,
-				(*planeIter)->full ? 1 : 0,
-				(*planeIter)->plane->surface.lights,
-				&(*planeIter)->state);
-		}
+		float eye[3];
+		CULL_EyePosition(&gl_camera, eye);
+		IMP_Draw(gl_camera.model_view, eye, gImpostors);
+		IMP_Bake(context);
 	}
-	
-	// PASS 5 - Labels
+
+	// PASS 6 - Labels
 	if(is_blend)
 	{
 		gLabels.clear();
 		if ( gDrawLabels )
 		{
-			float	x_scale = 1.0;
-			float	y_scale = 1.0;
-			if (gHDROnRef && XPLMGetDatai(gHDROnRef)) {     // SSAA hack only if HDR enabled
-				if (gMSAAXRatioRef) {
-					x_scale = XPLMGetDataf(gMSAAXRatioRef);
-				}
-				if (gMSAAYRatioRef) {
-					y_scale = XPLMGetDataf(gMSAAYRatioRef);
-				}
-			}
-
-			GLint	vp[4];
-			if (viewportRef != nullptr) {
-				// sim/graphics/view/viewport	int[4]	n	Pixels	Current OpenGL viewport in device window coordinates.Note thiat this is left, bottom, right top, NOT left, bottom, width, height!!
-				int vpInt[4] = {0,0,0,0};
-				XPLMGetDatavi(viewportRef, vpInt, 0, 4);
-				vp[0] = vpInt[0];
-				vp[1] = vpInt[1];
-				vp[2] = vpInt[2] - vpInt[0];
-				vp[3] = vpInt[3] - vpInt[1];
-			} else {
-				glGetIntegerv(GL_VIEWPORT, vp);
-			}
+			float	x_scale = context.ssaaX;     // SSAA hack only if HDR enabled
+			float	y_scale = context.ssaaY;
+			const int * vp = context.viewport;
 
 			glMatrixMode(GL_PROJECTION);
 			glPushMatrix();
@@ -968,16 +1510,38 @@ void			XPMPDefaultPlaneRenderer(int is_blend)
 				y_scale = 1.0;
 			}
 
-			for (DistanceMap::iterator iter = myPlanes.begin(); iter != myPlanes.end(); ++iter)
-				if(iter->first < labelDist)
-					if(!iter->second.cull)		// IMPORTANT - airplane BEHIND us still maps XY onto screen...so we get 180 degree reflections.  But behind us acf are culled, so that's good.
-					{
-						gLabels.push_back({});
-						convert_to_2d(&gl_camera, vp, iter->second.x, iter->second.y, iter->second.z, 1.0, &gLabels.back().x, &gLabels.back().y);
-						gLabels.back().x /= x_scale;
-						gLabels.back().y /= y_scale;
-						gLabels.back().text = iter->second.plane->pos.label;
-					}
+			gLabelRecords.clear();
+			for (const auto &item : view.distanceQueue)
+			{
+				const PlaneToRender_t &record = view.records[item.index];
+				if(record.dist < labelDist)
+					if(!record.cull)		// IMPORTANT - airplane BEHIND us still maps XY onto screen...so we get 180 degree reflections.  But behind us acf are culled, so that's good.
+						gLabelRecords.push_back(item.index);
+			}
+
+			// Short on time, only the closest ones get a label.
+			if (detail < 1.0f)
+				gLabelRecords.resize(static_cast<std::size_t>(std::ceil(gLabelRecords.size() * detail)));
+
+			// The projection itself is pure math, so the workers can do it.  Every label goes
+			// through the same matrix, and the plane's position is its model matrix' translation.
+			float mvp[16];
+			XFORM_Multiply(gl_camera.proj, gl_camera.model_view, mvp);
+			gLabels.resize(gLabelRecords.size());
+			gWorkerPool.parallelFor(gLabelRecords.size(), kLabelChunk, [&](std::size_t begin, std::size_t end, unsigned)
+			{
+				for (std::size_t n = begin; n < end; ++n)
+				{
+					const PlaneToRender_t &record = view.records[gLabelRecords[n]];
+					LabelInstance_t &label = gLabels[n];
+					convert_to_2d(mvp, vp, frame.matrices[record.snapshot] + 12, &label.x, &label.y);
+					label.x /= x_scale;
+					label.y = label.y / y_scale + 10.0f;		// Just above the plane
+					label.text = record.plane->pos.label;
+					label.priority = record.plane->labelPriority;
+				}
+			});
+			LABEL_Declutter(gLabels, static_cast<float>(vp[2]) / x_scale, static_cast<float>(vp[3]) / y_scale, gPrefs.maxLabelCount);
 
 			glMatrixMode(GL_PROJECTION);
 			glPopMatrix();
@@ -987,32 +1551,43 @@ void			XPMPDefaultPlaneRenderer(int is_blend)
 		}
 	}
 
-	// Final hack - leave a note to ourselves for how many of Austin's planes we relocated to do TCAS.
-	gEnableCount = (lastMultiRefUsed + 2); // +1 for counter, +1 for own aircraft
-	// cleanup unused multiplayer datarefs
-	if (gHasControlOfAIAircraft) {
-		for (auto &ref : gMultiRefs) {
-			if (!ref.isReserved) { ref.resetValues(); }
-		}
-	}
-
 	gDumpOneRenderCycle = 0;
+	note_capacities(view);
+
+	// finally, cleanup textures - and whatever else is due.
+	gDrawTasks.run(gPrefs.taskBudgetMs);
+}
+
+void			XPMPDefaultPlaneRenderer(int is_blend)
+{
+	GOV_BeginCpu();
+	GOV_BeginGpu();
+	ALLOC_BeginWatch();
+	render_planes(FRAME_BeginView(), is_blend, false);
+	ALLOC_EndWatch();
+	GOV_EndGpu();
+	GOV_EndCpu();
+}
 
-	// finally, cleanup textures.
-	OBJ_MaintainTextures();
+void			XPMPDefaultShadowRenderer()
+{
+	GOV_BeginCpu();
+	GOV_BeginGpu();
+	ALLOC_BeginWatch();
+	render_planes(FRAME_BeginView(), 0, true);
+	ALLOC_EndWatch();
+	GOV_EndGpu();
+	GOV_EndCpu();
 }
 
 void XPMPDefaultLabelRenderer()
 {
 	if (gDrawLabels)
 	{
-		XPLMSetGraphicsState(0, 0, 0, 0, 1, 1, 0);
-		float color[4] = { 1, 1, 0, 1 };
-
-		for (const auto &label : gLabels)
-		{
-			XPLMDrawString(color, static_cast<int>(label.x), static_cast<int>(label.y) + 10, const_cast<char *>(label.text), nullptr, xplmFont_Basic);
-		}
+		GOV_BeginCpu();
+		const float color[4] = { 1, 1, 0, 1 };
+		LABEL_Draw(gLabels, color);
+		GOV_EndCpu();
 	}
 }
 
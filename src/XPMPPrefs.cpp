@@ -0,0 +1,51 @@
+#include "XPMPPrefs.h"
+#include "XPMPMultiplayerVars.h"
+
+#include <vector>
+
+// Function local, so the list is there before the first Pref_t registers itself.
+static std::vector<PrefBase_t *> &	all_prefs()
+{
+	static std::vector<PrefBase_t *>	prefs;
+	return prefs;
+}
+
+static std::vector<std::function<void()>>	gChangeCallbacks;
+
+Prefs_t	gPrefs;
+
+PrefBase_t::PrefBase_t(const char * section, const char * key) :
+	m_section(section), m_key(key)
+{
+	all_prefs().push_back(this);
+}
+
+template <>
+bool Pref_t<int>::refresh()
+{
+	const int value = gIntPrefsFunc ? gIntPrefsFunc(m_section, m_key, m_default) : m_default;
+	return m_value.exchange(value, std::memory_order_relaxed) != value;
+}
+
+template <>
+bool Pref_t<float>::refresh()
+{
+	const float value = gFloatPrefsFunc ? gFloatPrefsFunc(m_section, m_key, m_default) : m_default;
+	return m_value.exchange(value, std::memory_order_relaxed) != value;
+}
+
+void	PREFS_Refresh()
+{
+	bool changed = false;
+	for (PrefBase_t * pref : all_prefs())
+		changed |= pref->refresh();
+
+	if (changed)
+		for (const auto &callback : gChangeCallbacks)
+			callback();
+}
+
+void	PREFS_OnChange(std::function<void()> callback)
+{
+	gChangeCallbacks.push_back(std::move(callback));
+}
@@ -0,0 +1,94 @@
+#ifndef XPMPPREFS_H
+#define XPMPPREFS_H
+
+#include <atomic>
+#include <functional>
+
+/*
+ * XPMPPrefs
+ *
+ * The client hands us two callbacks to read ini keys, and some of them we need on every
+ * pass or for every model we match.  Instead of calling out for each read, every key we know
+ * of is a typed Pref_t in gPrefs: PREFS_Refresh asks the callbacks for all of them at once,
+ * and reading one is a plain load - safe from any thread.
+ *
+ * We refresh when the client sets the callbacks, about once a second from the flight loop,
+ * and when the client calls XPMPRefreshPrefs - so changing an ini value still takes effect
+ * the way it did when we called the callbacks every time, just a little later.  Without
+ * callbacks, every pref has its default.
+ *
+ */
+
+// Every Pref_t registers itself with the list PREFS_Refresh goes through.
+class PrefBase_t
+{
+public:
+	PrefBase_t(const char * section, const char * key);
+	virtual ~PrefBase_t() = default;
+
+	// Reads the value from the client.  Returns true if it changed.
+	virtual bool refresh() = 0;
+
+protected:
+	const char *	m_section;
+	const char *	m_key;
+};
+
+template <typename T>
+class Pref_t : public PrefBase_t
+{
+public:
+	Pref_t(const char * section, const char * key, T defaultValue) :
+		PrefBase_t(section, key), m_default(defaultValue), m_value(defaultValue) {}
+
+	operator T() const { return m_value.load(std::memory_order_relaxed); }
+	bool refresh() override;
+
+private:
+	const T			m_default;
+	std::atomic<T>	m_value;
+};
+
+struct Prefs_t {
+	Pref_t<float>	fullDistance			{ "planes", "full_distance", 3.0f };			// Miles in the reference view
+	Pref_t<int>		maxFullCount			{ "planes", "max_full_count", 100 };
+	Pref_t<int>		maxShadowCount			{ "planes", "max_shadow_count", 50 };
+	Pref_t<int>		impostors				{ "planes", "impostors", 0 };
+	Pref_t<int>		maxLabelCount			{ "planes", "max_label_count", 100 };
+	Pref_t<float>	frameBudgetMs			{ "planes", "frame_budget_ms", 0.0f };
+	Pref_t<float>	taskBudgetMs			{ "planes", "task_budget_ms", 1.0f };
+	Pref_t<int>		workerThreads			{ "planes", "worker_threads", 3 };
+	Pref_t<int>		backgroundRefreshCount	{ "planes", "background_refresh_count", 100 };
+	Pref_t<int>		resolution				{ "planes", "resolution", 5 };
+	Pref_t<float>	textureAnisotropy		{ "planes", "texture_anisotropy", 0.0f };
+
+	Pref_t<int>		debugModelMatching		{ "debug", "model_matching", 0 };
+	Pref_t<int>		debugTcasTraffic		{ "debug", "tcas_traffic", 1 };
+	Pref_t<int>		debugLocalConversion	{ "debug", "local_conversion", 0 };
+	Pref_t<int>		debugRenderPhases		{ "debug", "render_phases", 0 };
+	Pref_t<int>		debugAllowObj8AsyncLoad	{ "debug", "allow_obj8_async_load", 0 };
+};
+
+template <> bool Pref_t<int>::refresh();
+template <> bool Pref_t<float>::refresh();
+
+extern Prefs_t	gPrefs;
+
+/*
+ * PREFS_Refresh
+ *
+ * Reads all prefs from the client's callbacks.  If any of them changed, calls the PREFS_OnChange
+ * callbacks afterwards.  Call from the main thread.
+ *
+ */
+void	PREFS_Refresh();
+
+/*
+ * PREFS_OnChange
+ *
+ * Registers a callback for PREFS_Refresh to call when any pref changed.
+ *
+ */
+void	PREFS_OnChange(std::function<void()> callback);
+
+#endif
@@ -0,0 +1,97 @@
+#include "XPMPRenderQueue.h"
+
+#include <cstring>
+#include <utility>
+
+// Below this many items an insertion sort beats building eight histograms.
+static const std::size_t kRadixThreshold = 32;
+
+uint32_t	RQ_QuantizeDepth(float depth)
+{
+	// IEEE floats compare like sign-magnitude integers, so for non-negative
+	// values the raw bits are already in the right order.
+	if (!(depth > 0.0f)) { return 0; }		// also catches NaN
+	uint32_t bits;
+	std::memcpy(&bits, &depth, sizeof(bits));
+	return bits;
+}
+
+uint32_t	RQ_FoldHandle(const void * handle)
+{
+	uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+	h >>= 4;								// heap pointers are at least 16 byte aligned
+	h ^= (h >> 24) ^ (h >> 48);
+	return static_cast<uint32_t>(h & 0xFFFFFF);
+}
+
+uint64_t	RQ_MakeKey(unsigned pass, unsigned planeType, uint32_t stateHandle, float depth, bool backToFront)
+{
+	uint64_t key = (static_cast<uint64_t>(pass & 0xF) << 60) |
+				   (static_cast<uint64_t>(planeType & 0xF) << 56);
+	const uint64_t state = stateHandle & 0xFFFFFF;
+	const uint64_t quantized = RQ_QuantizeDepth(depth);
+	if (backToFront)
+		key |= (static_cast<uint64_t>(~static_cast<uint32_t>(quantized)) << 24) | state;
+	else
+		key |= (state << 32) | quantized;
+	return key;
+}
+
+void RenderQueue::sort()
+{
+	const std::size_t n = m_items.size();
+	if (n < 2) { return; }
+
+	if (n <= kRadixThreshold)
+	{
+		for (std::size_t i = 1; i < n; ++i)
+		{
+			RenderQueueItem_t item = m_items[i];
+			std::size_t j = i;
+			for (; j > 0 && m_items[j - 1].key > item.key; --j)
+				m_items[j] = m_items[j - 1];
+			m_items[j] = item;
+		}
+		return;
+	}
+
+	// LSD radix sort, one byte per pass.  All eight histograms are built in a single
+	// read over the data, and any byte that has the same value in every key (the pass
+	// and type bytes usually do) is skipped entirely.
+	uint32_t counts[8][256];
+	std::memset(counts, 0, sizeof(counts));
+	for (const auto &item : m_items)
+	{
+		uint64_t k = item.key;
+		for (int b = 0; b < 8; ++b, k >>= 8)
+			++counts[b][k & 0xFF];
+	}
+
+	m_scratch.resize(n);
+	RenderQueueItem_t *src = m_items.data();
+	RenderQueueItem_t *dst = m_scratch.data();
+
+	for (int b = 0; b < 8; ++b)
+	{
+		uint32_t *count = counts[b];
+		const unsigned firstByte = static_cast<unsigned>((src[0].key >> (b * 8)) & 0xFF);
+		if (count[firstByte] == n) { continue; }
+
+		uint32_t offset = 0;
+		for (int v = 0; v < 256; ++v)
+		{
+			const uint32_t c = count[v];
+			count[v] = offset;
+			offset += c;
+		}
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			const unsigned v = static_cast<unsigned>((src[i].key >> (b * 8)) & 0xFF);
+			dst[count[v]++] = src[i];
+		}
+		std::swap(src, dst);
+	}
+
+	if (src != m_items.data())
+		std::memcpy(m_items.data(), src, n * sizeof(RenderQueueItem_t));
+}
@@ -0,0 +1,93 @@
+#ifndef XPMPRENDERQUEUE_H
+#define XPMPRENDERQUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * XPMPRenderQueue
+ *
+ * The render queue is a flat list of (sort key, record index) pairs.  The renderer pushes
+ * one entry per thing it wants to draw and a radix sort puts the whole list into the
+ * optimal OpenGL order in O(n).  A key packs, from the most significant bits down:
+ *
+ *   opaque passes:	pass (4) | plane type (4) | state handle (24) | depth (32)
+ *   blended passes:	pass (4) | plane type (4) | inverted depth (32) | state handle (24)
+ *
+ * so opaque things come out grouped by texture/object and front to back inside a group,
+ * while blended things come out strictly back to front.
+ *
+ * The queue keeps its storage between frames; once it has grown to the high water mark
+ * of the session, filling and sorting it doesn't touch the heap anymore.
+ *
+ */
+
+// Render passes, in the order they are drawn.
+enum {
+	rq_pass_NoModel = 0,		// planes without a CSL model, drawn with the user's acf
+	rq_pass_Austin,				// ACF planes via XPLMDrawAircraft
+	rq_pass_Obj8_Solid,			// OBJ8 solid attachments
+	rq_pass_Obj,				// OBJ7 planes
+	rq_pass_Lights,				// OBJ7 textured lights
+	rq_pass_Obj8_Glass,			// OBJ8 glass attachments
+	rq_pass_Count
+};
+
+struct RenderQueueItem_t {
+	uint64_t	key;
+	uint32_t	index;			// caller defined, usually an index into a record array
+};
+
+/*
+ * RQ_QuantizeDepth
+ *
+ * Maps a non-negative distance onto 32 bits so that the integer order matches the float order.
+ *
+ */
+uint32_t	RQ_QuantizeDepth(float depth);
+
+/*
+ * RQ_FoldHandle
+ *
+ * Folds a pointer (a texture, object or model) into the 24 bits of state handle a key can hold.
+ * Different pointers may fold onto the same value, which only costs us a bit of sort quality.
+ *
+ */
+uint32_t	RQ_FoldHandle(const void * handle);
+
+/*
+ * RQ_MakeKey
+ *
+ * Builds a sort key.  For back to front passes the depth is inverted and placed above the state
+ * handle, so transparency ordering always wins over state sorting.
+ *
+ */
+uint64_t	RQ_MakeKey(unsigned pass, unsigned planeType, uint32_t stateHandle, float depth, bool backToFront);
+
+inline unsigned RQ_KeyPass(uint64_t key) { return static_cast<unsigned>(key >> 60); }
+
+class RenderQueue
+{
+public:
+	using const_iterator = std::vector<RenderQueueItem_t>::const_iterator;
+
+	void clear() { m_items.clear(); }
+	void push(uint64_t key, uint32_t index) { m_items.push_back({ key, index }); }
+
+	// Sorts the queue ascending by key.  Stable, so equal keys keep their push order.
+	void sort();
+
+	bool empty() const { return m_items.empty(); }
+	std::size_t size() const { return m_items.size(); }
+	std::size_t capacity() const { return m_items.capacity() + m_scratch.capacity(); }	// All the storage we hold on to
+	const RenderQueueItem_t &operator[](std::size_t i) const { return m_items[i]; }
+	const_iterator begin() const { return m_items.begin(); }
+	const_iterator end() const { return m_items.end(); }
+
+private:
+	std::vector<RenderQueueItem_t> m_items;
+	std::vector<RenderQueueItem_t> m_scratch;
+};
+
+#endif
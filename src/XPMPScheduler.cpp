@@ -0,0 +1,44 @@
+#include "XPMPScheduler.h"
+
+void TaskScheduler::add(float hz, Task task)
+{
+	Entry_t entry;
+	entry.interval = hz > 0.0f ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / hz)) : Clock::duration::zero();
+	entry.due = Clock::time_point();
+	entry.resuming = false;
+	entry.task = std::move(task);
+	m_tasks.push_back(std::move(entry));
+}
+
+void TaskScheduler::run(double budgetMs)
+{
+	const std::size_t count = m_tasks.size();
+	if (count == 0) { return; }
+
+	const Clock::time_point start = Clock::now();
+	const Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(budgetMs));
+
+	// Round robin, starting after the last task that got to run - so a task that eats the whole
+	// budget goes last next frame, and everyone gets their turn.
+	bool ranOne = false;
+	std::size_t last = m_next + count - 1;
+	for (std::size_t n = 0; n < count; ++n)
+	{
+		Entry_t &entry = m_tasks[(m_next + n) % count];
+		if (!entry.resuming && start < entry.due) { continue; }
+		if (ranOne && Clock::now() >= deadline) { break; }
+
+		ranOne = true;
+		last = m_next + n;
+		const bool done = entry.task(deadline);
+		entry.resuming = !done;
+		if (done)
+		{
+			// Keep the rate, but don't try to catch up on turns we missed.
+			entry.due += entry.interval;
+			if (entry.due < start)
+				entry.due = start + entry.interval;
+		}
+	}
+	m_next = (last + 1) % count;
+}
@@ -0,0 +1,42 @@
+#ifndef XPMPSCHEDULER_H
+#define XPMPSCHEDULER_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// TaskScheduler spreads work that doesn't have to happen every frame over several frames.  Every
+// task has its own rate, and run() only starts tasks that are due, in turn, until the frame's time
+// budget is used up - whatever is left waits for the next frame.  A task that runs out of time
+// itself returns false, and is resumed on its next turn; it keeps its own state to pick up where
+// it left off.  Turns go round robin, and at least one task runs per frame, so nothing starves
+// on a tight budget.
+class TaskScheduler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Does some work.  Returns true once it is done until its next turn, false to be resumed.
+	using Task = std::function<bool(Clock::time_point deadline)>;
+
+	// hz is how often the task runs - 0 for every time run() is called.
+	void add(float hz, Task task);
+	void clear() { m_tasks.clear(); m_next = 0; }
+
+	// Runs what's due, for about budgetMs.
+	void run(double budgetMs);
+
+private:
+	struct Entry_t {
+		Clock::duration		interval;
+		Clock::time_point	due;
+		bool				resuming;
+		Task				task;
+	};
+
+	std::vector<Entry_t> m_tasks;
+	std::size_t m_next = 0;			// Where the next run() starts looking - right after the last task that ran
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include "XPMPSpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+// Tiles are one degree square - about 111 km north to south, so even a big visibility range
+// only touches a handful of them.
+static const int	kTilesLat = 180;
+static const int	kTilesLon = 360;
+
+static const double	kMetersPerDegreeLat = 111120.0;
+
+// Planes we have never had a position for live in this extra tile, which every query returns.
+static const int	kUnfiledTile = kTilesLat * kTilesLon;
+
+// Above this latitude a query just takes every tile around the pole.
+static const double	kPolarLat = 85.0;
+
+static std::unordered_map<int, std::vector<XPMPPlanePtr>>	gTiles;
+
+// Every plane, by when it is due for a background poll: a binary min-heap where each plane knows
+// its slot, so it can leave in O(log n).  The renderer pushes backgroundPoll out for the planes it
+// polls itself without telling us - their entries are only moved once they come up.
+struct	BackgroundEntry_t {
+	float			due;
+	XPMPPlanePtr	plane;
+};
+static std::vector<BackgroundEntry_t>	gBackground;
+
+static int tile_row(double lat)
+{
+	const int row = static_cast<int>(std::floor(lat + 90.0));
+	return std::min(std::max(row, 0), kTilesLat - 1);
+}
+
+static int tile_col(double lon)
+{
+	const int col = static_cast<int>(std::floor(lon + 180.0)) % kTilesLon;
+	return col < 0 ? col + kTilesLon : col;
+}
+
+static int tile_key(int row, int col)
+{
+	return row * kTilesLon + col;
+}
+
+static void background_place(std::size_t slot, const BackgroundEntry_t &entry)
+{
+	gBackground[slot] = entry;
+	entry.plane->backgroundSlot = slot;
+}
+
+static void background_sift_up(std::size_t slot)
+{
+	const BackgroundEntry_t entry = gBackground[slot];
+	while (slot > 0)
+	{
+		const std::size_t parent = (slot - 1) / 2;
+		if (gBackground[parent].due <= entry.due) { break; }
+		background_place(slot, gBackground[parent]);
+		slot = parent;
+	}
+	background_place(slot, entry);
+}
+
+static void background_sift_down(std::size_t slot)
+{
+	const BackgroundEntry_t entry = gBackground[slot];
+	const std::size_t count = gBackground.size();
+	for (;;)
+	{
+		std::size_t child = 2 * slot + 1;
+		if (child >= count) { break; }
+		if (child + 1 < count && gBackground[child + 1].due < gBackground[child].due) { ++child; }
+		if (entry.due <= gBackground[child].due) { break; }
+		background_place(slot, gBackground[child]);
+		slot = child;
+	}
+	background_place(slot, entry);
+}
+
+static void background_remove(XPMPPlanePtr plane)
+{
+	const std::size_t slot = plane->backgroundSlot;
+	if (slot >= gBackground.size() || gBackground[slot].plane != plane) { return; }
+
+	const BackgroundEntry_t last = gBackground.back();
+	gBackground.pop_back();
+	if (slot == gBackground.size()) { return; }
+	background_place(slot, last);
+	background_sift_up(slot);
+	background_sift_down(last.plane->backgroundSlot);
+}
+
+static void unfile_plane(XPMPPlanePtr plane)
+{
+	if (plane->spatialTile < 0) { return; }
+
+	auto tile = gTiles.find(plane->spatialTile);
+	if (tile != gTiles.end())
+	{
+		// Swap and pop, so removal is O(1).  The plane we move has to learn its new slot.
+		std::vector<XPMPPlanePtr> &planes = tile->second;
+		planes[plane->spatialSlot] = planes.back();
+		planes[plane->spatialSlot]->spatialSlot = plane->spatialSlot;
+		planes.pop_back();
+		// Empty tiles stay, so planes going back and forth over a tile edge don't allocate.
+	}
+	plane->spatialTile = -1;
+	plane->spatialSlot = 0;
+}
+
+void	SPATIAL_Remove(XPMPPlanePtr plane)
+{
+	unfile_plane(plane);
+	background_remove(plane);
+}
+
+static void file_plane(XPMPPlanePtr plane, int key)
+{
+	if (key == plane->spatialTile) { return; }
+
+	unfile_plane(plane);
+	std::vector<XPMPPlanePtr> &planes = gTiles[key];
+	plane->spatialTile = key;
+	plane->spatialSlot = planes.size();
+	planes.push_back(plane);
+}
+
+void	SPATIAL_Insert(XPMPPlanePtr plane)
+{
+	file_plane(plane, kUnfiledTile);
+	gBackground.push_back({ plane->backgroundPoll, plane });
+	background_sift_up(gBackground.size() - 1);
+}
+
+void	SPATIAL_Update(XPMPPlanePtr plane)
+{
+	file_plane(plane, tile_key(tile_row(plane->pos.lat), tile_col(plane->pos.lon)));
+}
+
+void	SPATIAL_Query(double lat, double lon, double radiusMeters, std::vector<XPMPPlanePtr> & outPlanes)
+{
+	const double radiusLat = radiusMeters / kMetersPerDegreeLat;
+	const int rowMin = tile_row(lat - radiusLat);
+	const int rowMax = tile_row(lat + radiusLat);
+
+	// The degrees of longitude we need grow towards the poles.  Use the latitude of the query
+	// edge closest to the pole, and just take the whole ring if we get too close.
+	const double edgeLat = std::min(std::fabs(lat) + radiusLat, 90.0);
+	int colMin = 0;
+	int colSpan = kTilesLon;
+	if (edgeLat < kPolarLat)
+	{
+		const double radiusLon = radiusLat / std::cos(edgeLat * 3.14159265358979323846 / 180.0);
+		colMin = static_cast<int>(std::floor(lon - radiusLon + 180.0));
+		colSpan = std::min(static_cast<int>(std::floor(lon + radiusLon + 180.0)) - colMin + 1, kTilesLon);
+	}
+
+	auto unfiled = gTiles.find(kUnfiledTile);
+	if (unfiled != gTiles.end())
+		outPlanes.insert(outPlanes.end(), unfiled->second.begin(), unfiled->second.end());
+
+	for (int row = rowMin; row <= rowMax; ++row)
+	{
+		for (int c = 0; c < colSpan; ++c)
+		{
+			const int col = tile_col(colMin + c - 180.0);	// wraps around the date line
+			auto tile = gTiles.find(tile_key(row, col));
+			if (tile != gTiles.end())
+				outPlanes.insert(outPlanes.end(), tile->second.begin(), tile->second.end());
+		}
+	}
+}
+
+std::size_t	SPATIAL_RefreshBackground(std::size_t count, float now)
+{
+	// Only ever look at the planes that are due.  One the renderer polled in the meantime is due
+	// later than its entry says, and just moves back to where it belongs.
+	std::size_t polled = 0;
+	while (polled < count && !gBackground.empty() && gBackground.front().due <= now)
+	{
+		XPMPPlanePtr plane = gBackground.front().plane;
+		const bool due = plane->backgroundPoll <= now;
+		if (due)
+			plane->backgroundPoll = now + kHibernateInterval;
+		gBackground.front().due = plane->backgroundPoll;
+		background_sift_down(0);
+
+		// The queue is in order again before we call into the client.
+		if (due)
+		{
+			XPMPPlanePosition_t pos;
+			pos.size = sizeof(pos);
+			XPMPGetPlaneData(plane, xpmpDataType_Position, &pos);
+			++polled;
+		}
+	}
+	return polled;
+}
@@ -0,0 +1,73 @@
+#ifndef XPMPSPATIALINDEX_H
+#define XPMPSPATIALINDEX_H
+
+#include "XPMPMultiplayerVars.h"
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * XPMPSpatialIndex
+ *
+ * A lat/lon tile grid over all planes, so the renderer only has to visit the planes that
+ * can possibly be in range instead of every plane we know about.  Planes are filed by their
+ * last known position; XPMPGetPlaneData keeps that up to date whenever it pulls a new
+ * position from the client, moving a plane to another tile only when it crosses a border.
+ *
+ * Planes that are never near the user are never asked for their position by the renderer,
+ * so SPATIAL_RefreshBackground polls them about once a second to notice when they fly into
+ * range.  The index keeps every plane in a queue by when it is due, so that only looks at the
+ * planes that actually are.
+ *
+ */
+
+// How often planes out of range are asked where they are, in seconds.
+const float	kHibernateInterval = 1.0f;
+
+/*
+ * SPATIAL_Insert
+ *
+ * Adds a new plane.  Until we have a position for it, every query returns it.
+ *
+ */
+void	SPATIAL_Insert(XPMPPlanePtr plane);
+
+/*
+ * SPATIAL_Update
+ *
+ * Files the plane under its current position.  Cheap if the plane is still in the same tile.
+ *
+ */
+void	SPATIAL_Update(XPMPPlanePtr plane);
+
+/*
+ * SPATIAL_Remove
+ *
+ * Takes the plane out of the index.  Must be called before a plane is destroyed.
+ *
+ */
+void	SPATIAL_Remove(XPMPPlanePtr plane);
+
+/*
+ * SPATIAL_Query
+ *
+ * Appends all planes that may be within radiusMeters of the given point, plus the ones we don't
+ * have a position for yet.  Works on whole tiles, so some of the planes returned will be farther
+ * away - callers still check distance.
+ *
+ */
+void	SPATIAL_Query(double lat, double lon, double radiusMeters, std::vector<XPMPPlanePtr> & outPlanes);
+
+/*
+ * SPATIAL_RefreshBackground
+ *
+ * Pulls a new position for the planes whose backgroundPoll time has come, at most count of them
+ * per call, and makes them due again a second later.  Returns how many it polled - fewer than
+ * count means nobody else is due.  Planes in range don't need this - the renderer keeps pushing
+ * their backgroundPoll out while it polls them itself, and they just get requeued about once a
+ * second.
+ *
+ */
+std::size_t	SPATIAL_RefreshBackground(std::size_t count, float now);
+
+#endif
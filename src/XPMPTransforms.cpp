@@ -0,0 +1,127 @@
+#include "XPMPTransforms.h"
+
+#include <cmath>
+#include <cstdint>
+
+static const float	kDegToRad = 3.14159265358979323846f / 180.0f;
+
+// Matrices are aligned to this many bytes.
+static const std::size_t	kMatrixAlign = 64;
+
+// Scratch space for the sines and cosines of a batch.
+static std::vector<float>	gSin[3];
+static std::vector<float>	gCos[3];
+
+/*
+ * Branch free single precision sincos: round to the nearest quadrant, reduce by pi/2 in three
+ * parts (Cody-Waite), evaluate the cephes polynomials on [-pi/4, pi/4] and pick the results by
+ * quadrant.  Same scheme as the double precision one in XPMPLocalFrame.
+ *
+ */
+static inline void sincos_nobranch(float x, float * outSin, float * outCos)
+{
+	static const float kTwoOverPi = 0.636619772367581343f;
+	static const float kPiO2_1 = 1.5703125f;
+	static const float kPiO2_2 = 4.837512969970703125e-4f;
+	static const float kPiO2_3 = 7.54978995489188216e-8f;
+	static const float kRoundMagic = 12582912.0f;				// 1.5 * 2^23
+
+	static const float S1 = -1.6666654611e-1f;
+	static const float S2 =  8.3321608736e-3f;
+	static const float S3 = -1.9515295891e-4f;
+
+	static const float C1 =  4.166664568298827e-2f;
+	static const float C2 = -1.388731625493765e-3f;
+	static const float C3 =  2.443315711809948e-5f;
+
+	// Adding the magic number rounds to the nearest integer without a float to int conversion.
+	// Doing it again on n / 4 gets us the quadrant, as d in -2..2 (2 and -2 both mean quadrant 2).
+	const float n = (x * kTwoOverPi + kRoundMagic) - kRoundMagic;
+	const float d = n - 4.0f * ((n * 0.25f + kRoundMagic) - kRoundMagic);
+	const bool odd = std::fabs(d) == 1.0f;
+	const bool half = std::fabs(d) == 2.0f;
+
+	const float r = ((x - n * kPiO2_1) - n * kPiO2_2) - n * kPiO2_3;
+	const float z = r * r;
+	const float s = r + r * z * (S1 + z * (S2 + z * S3));
+	const float c = 1.0f - 0.5f * z + z * z * (C1 + z * (C2 + z * C3));
+
+	const float sinMag = odd ? c : s;
+	const float cosMag = odd ? s : c;
+	*outSin = (half || d == -1.0f) ? -sinMag : sinMag;
+	*outCos = (half || d == 1.0f) ? -cosMag : cosMag;
+}
+
+void PlaneMatrices_t::resize(std::size_t n)
+{
+	const std::size_t slack = kMatrixAlign / sizeof(float);
+	if (m_storage.size() < 16 * n + slack)
+		m_storage.resize(16 * n + slack);
+	const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(m_storage.data());
+	m_first = m_storage.data() + ((kMatrixAlign - address % kMatrixAlign) % kMatrixAlign) / sizeof(float);
+	m_count = n;
+}
+
+void	XFORM_SinCos(std::size_t n, const float * __restrict degrees, float * __restrict outSin, float * __restrict outCos)
+{
+	for (std::size_t i = 0; i < n; ++i)
+		sincos_nobranch(degrees[i] * kDegToRad, &outSin[i], &outCos[i]);
+}
+
+// One matrix from the sines and cosines of its angles.  See the header for the rotation order.
+static inline void fill_matrix(float x, float y, float z,
+							   float sp, float cp, float sr, float cr, float sh, float ch, float * __restrict m)
+{
+	m[ 0] = ch * cr + sh * sp * sr;
+	m[ 1] = -cp * sr;
+	m[ 2] = sh * cr - ch * sp * sr;
+	m[ 3] = 0.0f;
+
+	m[ 4] = ch * sr - sh * sp * cr;
+	m[ 5] = cp * cr;
+	m[ 6] = sh * sr + ch * sp * cr;
+	m[ 7] = 0.0f;
+
+	m[ 8] = -sh * cp;
+	m[ 9] = -sp;
+	m[10] = ch * cp;
+	m[11] = 0.0f;
+
+	m[12] = x;
+	m[13] = y;
+	m[14] = z;
+	m[15] = 1.0f;
+}
+
+void	XFORM_ModelMatrices(std::size_t n, const float * x, const float * y, const float * z,
+							const AttitudeBatch_t & attitudes, PlaneMatrices_t & outMatrices)
+{
+	const float * angles[3] = { attitudes.pitch.data(), attitudes.roll.data(), attitudes.heading.data() };
+	for (int a = 0; a < 3; ++a)
+	{
+		gSin[a].resize(n);
+		gCos[a].resize(n);
+		XFORM_SinCos(n, angles[a], gSin[a].data(), gCos[a].data());
+	}
+
+	outMatrices.resize(n);
+	for (std::size_t i = 0; i < n; ++i)
+		fill_matrix(x[i], y[i], z[i], gSin[0][i], gCos[0][i], gSin[1][i], gCos[1][i], gSin[2][i], gCos[2][i], outMatrices[i]);
+}
+
+void	XFORM_ModelMatrix(float x, float y, float z, float pitch, float roll, float heading, float outMatrix[16])
+{
+	float sp, cp, sr, cr, sh, ch;
+	sincos_nobranch(pitch * kDegToRad, &sp, &cp);
+	sincos_nobranch(roll * kDegToRad, &sr, &cr);
+	sincos_nobranch(heading * kDegToRad, &sh, &ch);
+	fill_matrix(x, y, z, sp, cp, sr, cr, sh, ch, outMatrix);
+}
+
+void	XFORM_Multiply(const float a[16], const float b[16], float outMatrix[16])
+{
+	for (int col = 0; col < 4; ++col)
+		for (int row = 0; row < 4; ++row)
+			outMatrix[col * 4 + row] = a[row] * b[col * 4] + a[4 + row] * b[col * 4 + 1] +
+									   a[8 + row] * b[col * 4 + 2] + a[12 + row] * b[col * 4 + 3];
+}
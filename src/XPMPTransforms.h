@@ -0,0 +1,88 @@
+#ifndef XPMPTRANSFORMS_H
+#define XPMPTRANSFORMS_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * XPMPTransforms
+ *
+ * Model matrices for whole batches of planes.  Instead of a glTranslate and three glRotates
+ * per plane and draw call - and undoing them again for every light - the flight loop builds
+ * each plane's model matrix once per frame: the sines and cosines of all attitudes in one
+ * branch free loop the compiler can vectorize, then one 4x4 matrix per plane.  Drawing loads
+ * them with glMultMatrixf, lights use them to place their billboards in the world directly.
+ *
+ * The matrices are column major, like OpenGL's, and match
+ *
+ *	glTranslatef(x, y, z);
+ *	glRotatef(heading, 0.0, -1.0, 0.0);
+ *	glRotatef(pitch, 1.0, 0.0, 0.0);
+ *	glRotatef(roll, 0.0, 0.0, -1.0);
+ *
+ */
+
+// A batch of plane attitudes, in degrees, as a structure of arrays.
+struct AttitudeBatch_t {
+	std::vector<float>	pitch;
+	std::vector<float>	roll;
+	std::vector<float>	heading;
+
+	void clear() { pitch.clear(); roll.clear(); heading.clear(); }
+	void push(float inPitch, float inRoll, float inHeading) { pitch.push_back(inPitch); roll.push_back(inRoll); heading.push_back(inHeading); }
+	std::size_t size() const { return pitch.size(); }
+};
+
+// One 4x4 matrix per plane.  Every matrix starts on a cache line, so one load never straddles two.
+struct PlaneMatrices_t {
+	PlaneMatrices_t() = default;
+	PlaneMatrices_t(const PlaneMatrices_t &) = delete;
+	PlaneMatrices_t & operator=(const PlaneMatrices_t &) = delete;
+
+	void resize(std::size_t n);
+	std::size_t size() const { return m_count; }
+	float * operator[](std::size_t n) { return m_first + 16 * n; }
+	const float * operator[](std::size_t n) const { return m_first + 16 * n; }
+
+private:
+	std::vector<float>	m_storage;
+	float *				m_first = nullptr;
+	std::size_t			m_count = 0;
+};
+
+/*
+ * XFORM_SinCos
+ *
+ * Sine and cosine of n angles in degrees.  Branch free, so the compiler can vectorize it, and
+ * good to a few float ulps for any angle a plane might report.
+ *
+ */
+void	XFORM_SinCos(std::size_t n, const float * __restrict degrees, float * __restrict outSin, float * __restrict outCos);
+
+/*
+ * XFORM_ModelMatrices
+ *
+ * Builds the model matrices for a batch of planes.  The positions are separate arrays so the
+ * culling spheres' centers can be used as they are.
+ *
+ */
+void	XFORM_ModelMatrices(std::size_t n, const float * x, const float * y, const float * z,
+							const AttitudeBatch_t & attitudes, PlaneMatrices_t & outMatrices);
+
+/*
+ * XFORM_ModelMatrix
+ *
+ * The same for a single plane, for the odd one drawn outside of a batch.
+ *
+ */
+void	XFORM_ModelMatrix(float x, float y, float z, float pitch, float roll, float heading, float outMatrix[16]);
+
+/*
+ * XFORM_Multiply
+ *
+ * out = a * b, all column major.  out may not be a or b.
+ *
+ */
+void	XFORM_Multiply(const float a[16], const float b[16], float outMatrix[16]);
+
+#endif
@@ -0,0 +1,85 @@
+#include "XPMPWorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool gWorkerPool;
+
+void WorkerPool::start(unsigned threadCount)
+{
+	stop();
+	m_stop = false;
+	// The workers get the generation from here rather than reading it once they run: a worker that
+	// only starts after the first parallelFor would take that job's generation for an old one, wait
+	// for the next, and leave parallelFor waiting for it forever.
+	for (unsigned i = 0; i < threadCount; ++i)
+		m_threads.emplace_back(&WorkerPool::workerMain, this, i + 1, m_generation);	// worker 0 is the caller
+}
+
+void WorkerPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (auto &thread : m_threads)
+		thread.join();
+	m_threads.clear();
+}
+
+void WorkerPool::parallelFor(std::size_t count, std::size_t grain, const Job &job)
+{
+	if (count == 0) { return; }
+	grain = std::max<std::size_t>(grain, 1);
+	if (m_threads.empty() || count <= grain)
+	{
+		job(0, count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job = &job;
+		m_count = count;
+		m_grain = grain;
+		m_next = 0;
+		m_busy = static_cast<unsigned>(m_threads.size());
+		++m_generation;
+	}
+	m_wake.notify_all();
+
+	runChunks(0);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_busy == 0; });
+	m_job = nullptr;
+}
+
+void WorkerPool::runChunks(unsigned worker)
+{
+	for (;;)
+	{
+		const std::size_t begin = m_next.fetch_add(m_grain);
+		if (begin >= m_count) { return; }
+		(*m_job)(begin, std::min(begin + m_grain, m_count), worker);
+	}
+}
+
+void WorkerPool::workerMain(unsigned worker, unsigned seen)
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+			if (m_stop) { return; }
+			seen = m_generation;
+		}
+
+		runChunks(worker);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_busy == 0)
+			m_done.notify_one();
+	}
+}
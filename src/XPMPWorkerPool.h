@@ -0,0 +1,67 @@
+#ifndef XPMPWORKERPOOL_H
+#define XPMPWORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// WorkerPool is a small set of persistent threads for data parallel work in the renderer.
+// parallelFor cuts a range into chunks, the calling thread and the workers pull chunks until
+// none are left, and parallelFor returns once all of them are done.  Each chunk is told which
+// worker runs it, so callers can write into per worker output lists without any locking.
+// Small ranges, or a pool without threads, simply run on the calling thread.
+class WorkerPool
+{
+public:
+	// Anything callable as job(begin, end, worker), by reference.  parallelFor is done with it before
+	// it returns, so unlike a std::function there is nothing to copy, and nothing to allocate.
+	class Job
+	{
+	public:
+		template <typename F, typename = typename std::enable_if<!std::is_same<F, Job>::value>::type>
+		Job(const F &f) :
+			m_callable(&f),
+			m_call([](const void *callable, std::size_t begin, std::size_t end, unsigned worker)
+				   { (*static_cast<const F *>(callable))(begin, end, worker); }) {}
+
+		void operator()(std::size_t begin, std::size_t end, unsigned worker) const { m_call(m_callable, begin, end, worker); }
+
+	private:
+		const void *m_callable;
+		void (*m_call)(const void *callable, std::size_t begin, std::size_t end, unsigned worker);
+	};
+
+	~WorkerPool() { stop(); }
+
+	void start(unsigned threadCount);
+	void stop();
+
+	// Number of distinct worker indices a job may see, including the calling thread.
+	unsigned workerCount() const { return static_cast<unsigned>(m_threads.size()) + 1; }
+
+	void parallelFor(std::size_t count, std::size_t grain, const Job &job);
+
+private:
+	void workerMain(unsigned worker, unsigned seen);
+	void runChunks(unsigned worker);
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const Job *m_job = nullptr;
+	std::size_t m_count = 0;
+	std::size_t m_grain = 1;
+	std::atomic<std::size_t> m_next { 0 };
+	unsigned m_busy = 0;
+	unsigned m_generation = 0;
+	bool m_stop = false;
+};
+
+extern WorkerPool gWorkerPool;
+
+#endif
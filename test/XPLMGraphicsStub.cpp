@@ -0,0 +1,107 @@
+#include "XPLMGraphicsStub.h"
+
+#include "XPLMGraphics.h"
+#include "XPLMDataAccess.h"
+#include "XPLMUtilities.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const double	kDegToRad = 3.14159265358979323846 / 180.0;
+
+static double	gA = kStubWGS84_A;
+static double	gE2 = kStubWGS84_E2;
+static double	gRefLat = 0.0;
+static double	gRefLon = 0.0;
+static double	gRefElev = 0.0;
+
+static float	gEarthRadius = static_cast<float>(kStubWGS84_A);
+static int		gEarthRadiusRef = 0;		// Just something to point to
+
+static void geodetic_to_ecef(double lat, double lon, double elev, double ecef[3])
+{
+	const double sinLat = std::sin(lat * kDegToRad), cosLat = std::cos(lat * kDegToRad);
+	const double sinLon = std::sin(lon * kDegToRad), cosLon = std::cos(lon * kDegToRad);
+	const double N = gA / std::sqrt(1.0 - gE2 * sinLat * sinLat);
+	ecef[0] = (N + elev) * cosLat * cosLon;
+	ecef[1] = (N + elev) * cosLat * sinLon;
+	ecef[2] = (N * (1.0 - gE2) + elev) * sinLat;
+}
+
+// East, north and up at the reference point, as rows.
+static void reference_axes(double east[3], double north[3], double up[3])
+{
+	const double sinLat = std::sin(gRefLat * kDegToRad), cosLat = std::cos(gRefLat * kDegToRad);
+	const double sinLon = std::sin(gRefLon * kDegToRad), cosLon = std::cos(gRefLon * kDegToRad);
+	east[0] = -sinLon;				east[1] = cosLon;				east[2] = 0.0;
+	north[0] = -sinLat * cosLon;	north[1] = -sinLat * sinLon;	north[2] = cosLat;
+	up[0] = cosLat * cosLon;		up[1] = cosLat * sinLon;		up[2] = sinLat;
+}
+
+void	STUB_SetEarth(double a, double e2)
+{
+	// The dataref is a float, so a sphere can only be as big as a float says.
+	gEarthRadius = static_cast<float>(a);
+	gA = (e2 == 0.0) ? static_cast<double>(gEarthRadius) : a;
+	gE2 = e2;
+}
+
+void	STUB_SetReference(double lat, double lon, double elev)
+{
+	gRefLat = lat;
+	gRefLon = lon;
+	gRefElev = elev;
+}
+
+void XPLMWorldToLocal(double inLatitude, double inLongitude, double inAltitude, double * outX, double * outY, double * outZ)
+{
+	double p[3], o[3], east[3], north[3], up[3];
+	geodetic_to_ecef(inLatitude, inLongitude, inAltitude, p);
+	geodetic_to_ecef(gRefLat, gRefLon, gRefElev, o);
+	reference_axes(east, north, up);
+	const double d[3] = { p[0] - o[0], p[1] - o[1], p[2] - o[2] };
+	*outX = east[0] * d[0] + east[1] * d[1] + east[2] * d[2];
+	*outY = up[0] * d[0] + up[1] * d[1] + up[2] * d[2];
+	*outZ = -(north[0] * d[0] + north[1] * d[1] + north[2] * d[2]);
+}
+
+void XPLMLocalToWorld(double inX, double inY, double inZ, double * outLatitude, double * outLongitude, double * outAltitude)
+{
+	double o[3], east[3], north[3], up[3];
+	geodetic_to_ecef(gRefLat, gRefLon, gRefElev, o);
+	reference_axes(east, north, up);
+	double p[3];
+	for (int n = 0; n < 3; ++n)
+		p[n] = o[n] + east[n] * inX + up[n] * inY - north[n] * inZ;
+
+	// Back to geodetic, iterating on the latitude.
+	const double r = std::sqrt(p[0] * p[0] + p[1] * p[1]);
+	double lat = std::atan2(p[2], r * (1.0 - gE2));
+	double elev = 0.0;
+	for (int i = 0; i < 10; ++i)
+	{
+		const double sinLat = std::sin(lat);
+		const double N = gA / std::sqrt(1.0 - gE2 * sinLat * sinLat);
+		elev = r / std::cos(lat) - N;
+		lat = std::atan2(p[2], r * (1.0 - gE2 * N / (N + elev)));
+	}
+	*outLatitude = lat / kDegToRad;
+	*outLongitude = std::atan2(p[1], p[0]) / kDegToRad;
+	*outAltitude = elev;
+}
+
+XPLMDataRef XPLMFindDataRef(const char * inDataRefName)
+{
+	return std::strcmp(inDataRefName, "sim/physics/earth_radius_m") == 0 ? &gEarthRadiusRef : nullptr;
+}
+
+float XPLMGetDataf(XPLMDataRef inDataRef)
+{
+	return inDataRef == &gEarthRadiusRef ? gEarthRadius : 0.0f;
+}
+
+void XPLMDebugString(const char * inString)
+{
+	std::fputs(inString, stdout);
+}
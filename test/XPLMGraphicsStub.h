@@ -0,0 +1,35 @@
+#ifndef XPLMGRAPHICSSTUB_H
+#define XPLMGRAPHICSSTUB_H
+
+/*
+ * XPLMGraphicsStub
+ *
+ * Stands in for X-Plane's XPLMWorldToLocal and XPLMLocalToWorld, plus the earth radius dataref,
+ * so XPMPLocalFrame can run without a simulator.  The local frame works the way X-Plane's does:
+ * the reference point is at the origin, +X is east, +Y is up and -Z is north, all relative to the
+ * earth model's ellipsoid - WGS84, or a sphere.
+ *
+ */
+
+// WGS84, as X-Plane 10 and later use it.
+const double	kStubWGS84_A = 6378137.0;
+const double	kStubWGS84_E2 = 6.69437999014e-3;
+
+/*
+ * STUB_SetEarth
+ *
+ * The earth model to convert with: semi major axis and first eccentricity squared, 0 for a
+ * sphere.  sim/physics/earth_radius_m reads the semi major axis.
+ *
+ */
+void	STUB_SetEarth(double a, double e2);
+
+/*
+ * STUB_SetReference
+ *
+ * Moves the local origin to this point, like X-Plane does when the user's plane gets far from it.
+ *
+ */
+void	STUB_SetReference(double lat, double lon, double elev);
+
+#endif
@@ -0,0 +1,59 @@
+#include "XPLMInstanceStub.h"
+
+#include <cassert>
+#include <cstdint>
+
+static std::vector<StubInstance_t>	gInstances;
+
+// Instance refs are one past the index into gInstances, so no ref is ever null.
+static StubInstance_t &instance_for(XPLMInstanceRef ref)
+{
+	const std::size_t index = reinterpret_cast<std::uintptr_t>(ref) - 1;
+	assert(index < gInstances.size());
+	return gInstances[index];
+}
+
+XPLMInstanceRef XPLMCreateInstance(XPLMObjectRef obj, const char ** datarefs)
+{
+	StubInstance_t instance;
+	instance.object = obj;
+	for (const char ** name = datarefs; name && *name; ++name)
+		instance.datarefs.push_back(*name);
+	gInstances.push_back(instance);
+	return reinterpret_cast<XPLMInstanceRef>(static_cast<std::uintptr_t>(gInstances.size()));
+}
+
+void XPLMDestroyInstance(XPLMInstanceRef ref)
+{
+	StubInstance_t &instance = instance_for(ref);
+	assert(!instance.destroyed);
+	instance.destroyed = true;
+}
+
+void XPLMInstanceSetPosition(XPLMInstanceRef ref, const XPLMDrawInfo_t * location, const float * values)
+{
+	StubInstance_t &instance = instance_for(ref);
+	assert(!instance.destroyed);
+	instance.location = *location;
+	instance.values.assign(values, values + instance.datarefs.size());
+	++instance.positions;
+}
+
+const std::vector<StubInstance_t> &	STUB_Instances()
+{
+	return gInstances;
+}
+
+int		STUB_LiveInstances()
+{
+	int live = 0;
+	for (const auto &instance : gInstances)
+		if (!instance.destroyed)
+			++live;
+	return live;
+}
+
+void	STUB_Reset()
+{
+	gInstances.clear();
+}
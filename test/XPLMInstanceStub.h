@@ -0,0 +1,51 @@
+#ifndef XPLMINSTANCESTUB_H
+#define XPLMINSTANCESTUB_H
+
+#include "XPLMInstance.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * XPLMInstanceStub
+ *
+ * Stands in for X-Plane's XPLMCreateInstance, XPLMInstanceSetPosition and XPLMDestroyInstance,
+ * so XPMPInstances can run without a simulator.  Every instance created is kept, destroyed or not,
+ * with what was done to it.
+ *
+ */
+
+struct StubInstance_t {
+	XPLMObjectRef				object;
+	std::vector<std::string>	datarefs;
+	XPLMDrawInfo_t				location;		// As of the last XPLMInstanceSetPosition
+	std::vector<float>			values;
+	int							positions = 0;	// Number of XPLMInstanceSetPosition calls
+	bool						destroyed = false;
+};
+
+/*
+ * STUB_Instances
+ *
+ * Every instance since the last STUB_Reset, in the order they were created.
+ *
+ */
+const std::vector<StubInstance_t> &	STUB_Instances();
+
+/*
+ * STUB_LiveInstances
+ *
+ * How many of them aren't destroyed.
+ *
+ */
+int		STUB_LiveInstances();
+
+/*
+ * STUB_Reset
+ *
+ * Forgets all instances.  The ones still alive are leaked, as far as the stub is concerned.
+ *
+ */
+void	STUB_Reset();
+
+#endif
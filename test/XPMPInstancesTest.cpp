@@ -0,0 +1,234 @@
+// Runs XPMPInstances against the stub instance API: instances are made for loaded OBJ8 planes,
+// moved every frame, and dropped when their plane goes away or stops being updated.
+
+#include "XPMPInstances.h"
+#include "XPMPMultiplayerVars.h"
+#include "XPLMInstanceStub.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// The plane side of an instance: XPMPMultiplayerObj8 would pull in the whole OBJ8 loader, and
+// all we need here is a couple of datarefs.
+static const char *	sDatarefNames[] = { "libxplanemp/controls/gear_ratio", "libxplanemp/controls/flap_ratio", nullptr };
+
+const char **	OBJ8_DatarefNames() { return sDatarefNames; }
+int		OBJ8_DatarefCount() { return 2; }
+void	OBJ8_DatarefValues(const XPLMPlaneDrawState_t &state, xpmp_LightStatus, float * outValues)
+{
+	outValues[0] = state.gearPosition;
+	outValues[1] = state.flapRatio;
+}
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); ++gFailures; } } while (0)
+
+// Fake object refs - the stub never looks behind them.
+static XPLMObjectRef object_ref(int n)
+{
+	return reinterpret_cast<XPLMObjectRef>(static_cast<std::uintptr_t>(0x1000 + n));
+}
+
+static void add_attachment(XPMPPlane_t &plane, std::size_t index, int object)
+{
+	OBJ8Handle handle = std::make_shared<Obj8Ref_t>();
+	handle->objectRef = object_ref(object);
+	plane.obj8Handles[Obj8Info_t{ index, draw_solid }] = handle;
+}
+
+static XPLMDrawInfo_t location_at(float x)
+{
+	XPLMDrawInfo_t location;
+	std::memset(&location, 0, sizeof(location));
+	location.structSize = sizeof(location);
+	location.x = x;
+	location.y = 10.0f;
+	location.z = -20.0f;
+	location.heading = 90.0f;
+	return location;
+}
+
+static XPLMPlaneDrawState_t state_with(float gear, float flaps)
+{
+	XPLMPlaneDrawState_t state;
+	std::memset(&state, 0, sizeof(state));
+	state.structSize = sizeof(state);
+	state.gearPosition = gear;
+	state.flapRatio = flaps;
+	return state;
+}
+
+static bool update(XPMPPlane_t &plane, float x, float gear = 1.0f, float flaps = 0.0f)
+{
+	xpmp_LightStatus lights;
+	lights.lightFlags = 0;
+	return INST_UpdatePlane(&plane, location_at(x), state_with(gear, flaps), lights);
+}
+
+static void test_creation_and_position()
+{
+	STUB_Reset();
+	CSLPlane_t model;
+	model.plane_type = plane_Obj8;
+	XPMPPlane_t plane;
+	plane.model = &model;
+	add_attachment(plane, 0, 1);
+	add_attachment(plane, 1, 2);
+	plane.allObj8Loaded = true;
+
+	INST_BeginFrame();
+	CHECK(update(plane, 100.0f, 1.0f, 0.5f));
+	INST_EndFrame();
+
+	const auto &instances = STUB_Instances();
+	CHECK(instances.size() == 2);
+	CHECK(STUB_LiveInstances() == 2);
+	if (instances.size() == 2)
+	{
+		CHECK(instances[0].object == object_ref(1));
+		CHECK(instances[1].object == object_ref(2));
+		for (const auto &instance : instances)
+		{
+			CHECK(instance.datarefs.size() == 2 && instance.datarefs[0] == sDatarefNames[0] && instance.datarefs[1] == sDatarefNames[1]);
+			CHECK(instance.positions == 1);
+			CHECK(instance.location.x == 100.0f && instance.location.y == 10.0f && instance.location.z == -20.0f);
+			CHECK(instance.location.heading == 90.0f);
+			CHECK(instance.values.size() == 2 && instance.values[0] == 1.0f && instance.values[1] == 0.5f);
+		}
+	}
+
+	// The next frame only moves them.
+	INST_BeginFrame();
+	CHECK(update(plane, 150.0f, 0.0f, 0.25f));
+	INST_EndFrame();
+	CHECK(instances.size() == 2);
+	for (const auto &instance : instances)
+	{
+		CHECK(instance.positions == 2);
+		CHECK(instance.location.x == 150.0f);
+		CHECK(instance.values.size() == 2 && instance.values[0] == 0.0f && instance.values[1] == 0.25f);
+	}
+
+	INST_ForgetPlane(&plane);
+	CHECK(STUB_LiveInstances() == 0);
+	INST_Cleanup();
+}
+
+static void test_not_instanced()
+{
+	STUB_Reset();
+	CSLPlane_t model;
+	model.plane_type = plane_Obj;
+	XPMPPlane_t obj7;
+	obj7.model = &model;
+
+	CSLPlane_t obj8Model;
+	obj8Model.plane_type = plane_Obj8;
+	XPMPPlane_t loading;
+	loading.model = &obj8Model;
+	add_attachment(loading, 0, 1);
+
+	XPMPPlane_t noModel;
+
+	INST_BeginFrame();
+	CHECK(!update(obj7, 0.0f));
+	CHECK(!update(loading, 0.0f));
+	CHECK(!update(noModel, 0.0f));
+	INST_EndFrame();
+	CHECK(STUB_Instances().empty());
+	INST_Cleanup();
+}
+
+static void test_stale_planes_dropped()
+{
+	STUB_Reset();
+	CSLPlane_t model;
+	model.plane_type = plane_Obj8;
+	XPMPPlane_t staying, leaving;
+	for (XPMPPlane_t * plane : { &staying, &leaving })
+	{
+		plane->model = &model;
+		add_attachment(*plane, 0, 1);
+		plane->allObj8Loaded = true;
+	}
+
+	INST_BeginFrame();
+	CHECK(update(staying, 0.0f));
+	CHECK(update(leaving, 0.0f));
+	INST_EndFrame();
+	CHECK(STUB_LiveInstances() == 2);
+
+	// leaving went out of range: no update, so its instance goes.
+	INST_BeginFrame();
+	CHECK(update(staying, 1.0f));
+	INST_EndFrame();
+	const auto &instances = STUB_Instances();
+	CHECK(STUB_LiveInstances() == 1);
+	CHECK(instances.size() == 2 && !instances[0].destroyed && instances[1].destroyed);
+
+	// Back in range, it gets a new one.
+	INST_BeginFrame();
+	CHECK(update(staying, 2.0f));
+	CHECK(update(leaving, 2.0f));
+	INST_EndFrame();
+	CHECK(STUB_LiveInstances() == 2);
+	CHECK(instances.size() == 3);
+
+	INST_Cleanup();
+	CHECK(STUB_LiveInstances() == 0);
+}
+
+static void test_model_change()
+{
+	STUB_Reset();
+	CSLPlane_t model;
+	model.plane_type = plane_Obj8;
+	XPMPPlane_t plane;
+	plane.model = &model;
+	add_attachment(plane, 0, 1);
+	plane.allObj8Loaded = true;
+
+	INST_BeginFrame();
+	CHECK(update(plane, 0.0f));
+	INST_EndFrame();
+
+	// The plane got another model, with two attachments.
+	plane.obj8Handles.clear();
+	add_attachment(plane, 0, 3);
+	add_attachment(plane, 1, 4);
+
+	INST_BeginFrame();
+	CHECK(update(plane, 0.0f));
+	INST_EndFrame();
+	const auto &instances = STUB_Instances();
+	CHECK(instances.size() == 3);
+	CHECK(STUB_LiveInstances() == 2);
+	if (instances.size() == 3)
+	{
+		CHECK(instances[0].destroyed);
+		CHECK(instances[1].object == object_ref(3) && !instances[1].destroyed);
+		CHECK(instances[2].object == object_ref(4) && !instances[2].destroyed);
+	}
+
+	INST_Cleanup();
+	CHECK(STUB_LiveInstances() == 0);
+}
+
+int main()
+{
+	test_creation_and_position();
+	test_not_instanced();
+	test_stale_planes_dropped();
+	test_model_change();
+
+	if (gFailures > 0)
+	{
+		std::printf("%d check(s) failed\n", gFailures);
+		return 1;
+	}
+	std::printf("All checks passed\n");
+	return 0;
+}
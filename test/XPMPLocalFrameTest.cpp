@@ -0,0 +1,145 @@
+// Runs XPMPLocalFrame against the stub XPLMWorldToLocal: the frame we solve from four samples has
+// to agree with X-Plane's own conversion, for WGS84 and for a spherical earth, and has to follow
+// X-Plane when it moves its local origin.
+
+#include "XPMPLocalFrame.h"
+#include "XPLMGraphicsStub.h"
+
+#include "XPLMGraphics.h"
+
+#include <cmath>
+#include <cstdio>
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+	do { if (!(condition)) { std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); ++gFailures; } } while (0)
+
+static const double	kMaxError = 1.0;		// meters
+
+// Where X-Plane's answer and ours part, in meters.
+static double error_at(const LocalFrame_t &frame, double lat, double lon, double elev)
+{
+	double x, y, z, xx, yy, zz;
+	LOCAL_GeoToLocal(&frame, 1, &lat, &lon, &elev, &x, &y, &z);
+	XPLMWorldToLocal(lat, lon, elev, &xx, &yy, &zz);
+	return std::sqrt((x - xx) * (x - xx) + (y - yy) * (y - yy) + (z - zz) * (z - zz));
+}
+
+// Samples the way the library does: the origin, and a step north, east and up from it.
+static void take_samples(LocalFrameSample_t samples[4])
+{
+	XPLMLocalToWorld(0.0, 0.0, 0.0, &samples[0].lat, &samples[0].lon, &samples[0].elev);
+	samples[1] = samples[2] = samples[3] = samples[0];
+	samples[1].lat += 0.01;
+	samples[2].lon += 0.01;
+	samples[3].elev += 1000.0;
+	for (int n = 0; n < 4; ++n)
+		XPLMWorldToLocal(samples[n].lat, samples[n].lon, samples[n].elev, &samples[n].x, &samples[n].y, &samples[n].z);
+}
+
+static void check_solved_frame(double a, double e2, double refLat, double refLon, double refElev)
+{
+	STUB_SetEarth(a, e2);
+	STUB_SetReference(refLat, refLon, refElev);
+
+	LocalFrameSample_t samples[4];
+	take_samples(samples);
+	CHECK(std::fabs(samples[0].lat - refLat) < 1e-9 && std::fabs(samples[0].lon - refLon) < 1e-9 &&
+		  std::fabs(samples[0].elev - refElev) < 1e-3);
+
+	LocalFrame_t frame;
+	CHECK(LOCAL_SolveFrame(a, e2, samples, &frame));
+
+	// At the origin, and about 80 km away in each direction and up at cruise.
+	const double d = 80000.0 / 111120.0;
+	const double dLon = d / std::cos(refLat * 3.14159265358979323846 / 180.0);
+	CHECK(error_at(frame, refLat, refLon, refElev) < kMaxError);
+	CHECK(error_at(frame, refLat + d, refLon, refElev) < kMaxError);
+	CHECK(error_at(frame, refLat - d, refLon, refElev + 11000.0) < kMaxError);
+	CHECK(error_at(frame, refLat, refLon + dLon, refElev + 3000.0) < kMaxError);
+	CHECK(error_at(frame, refLat + 0.5 * d, refLon - dLon, refElev) < kMaxError);
+}
+
+static void test_solve_wgs84()
+{
+	check_solved_frame(kStubWGS84_A, kStubWGS84_E2, 50.0339, 8.5706, 111.0);		// Frankfurt
+	check_solved_frame(kStubWGS84_A, kStubWGS84_E2, -33.9461, 151.1772, 6.0);		// Sydney
+	check_solved_frame(kStubWGS84_A, kStubWGS84_E2, 64.1300, -21.9406, 52.0);		// Reykjavik
+}
+
+static void test_solve_sphere()
+{
+	check_solved_frame(6378145.0, 0.0, 50.0339, 8.5706, 111.0);
+	check_solved_frame(6378145.0, 0.0, 37.6189, -122.3750, 4.0);					// San Francisco
+}
+
+static void test_degenerate_samples()
+{
+	STUB_SetEarth(kStubWGS84_A, kStubWGS84_E2);
+	STUB_SetReference(50.0, 8.0, 100.0);
+	LocalFrameSample_t samples[4];
+	take_samples(samples);
+	samples[3] = samples[1];		// Two samples in the same place
+	LocalFrame_t frame;
+	CHECK(!LOCAL_SolveFrame(kStubWGS84_A, kStubWGS84_E2, samples, &frame));
+}
+
+// Converts one position through LOCAL_Convert and checks it against X-Plane.
+static double convert_error(LocalBatch_t &batch, double lat, double lon, double elev)
+{
+	batch.clear();
+	batch.push(lat, lon, elev);
+	LOCAL_Convert(batch);
+	double x, y, z;
+	XPLMWorldToLocal(lat, lon, elev, &x, &y, &z);
+	return std::sqrt((batch.x[0] - x) * (batch.x[0] - x) + (batch.y[0] - y) * (batch.y[0] - y) + (batch.z[0] - z) * (batch.z[0] - z));
+}
+
+static void test_origin_shift()
+{
+	LocalBatch_t batch;
+	STUB_SetEarth(kStubWGS84_A, kStubWGS84_E2);
+	STUB_SetReference(50.0339, 8.5706, 111.0);
+
+	CHECK(LOCAL_FrameSerial() == 0);
+	LOCAL_UpdateFrame();
+	CHECK(LOCAL_FrameSerial() == 1);
+	CHECK(convert_error(batch, 50.5, 8.9, 3000.0) < kMaxError);
+
+	// Nothing moved, nothing to rebuild.
+	LOCAL_UpdateFrame();
+	CHECK(LOCAL_FrameSerial() == 1);
+
+	// X-Plane moves its origin as the user flies on.  Until we notice, our frame is off...
+	STUB_SetReference(51.2, 9.8, 0.0);
+	CHECK(convert_error(batch, 51.3, 9.9, 2000.0) > kMaxError);
+	// ...and once we do, it is right again.
+	LOCAL_UpdateFrame();
+	CHECK(LOCAL_FrameSerial() == 2);
+	CHECK(convert_error(batch, 51.3, 9.9, 2000.0) < kMaxError);
+	CHECK(convert_error(batch, 51.2 + 80000.0 / 111120.0, 9.8, 500.0) < kMaxError);
+
+	// A sim with a spherical earth: WGS84 fails validation and the sphere is used instead.
+	STUB_SetEarth(6378145.0, 0.0);
+	STUB_SetReference(40.0, -74.0, 10.0);
+	LOCAL_UpdateFrame();
+	CHECK(LOCAL_FrameSerial() == 3);
+	CHECK(convert_error(batch, 40.4, -73.5, 9000.0) < kMaxError);
+}
+
+int main()
+{
+	test_solve_wgs84();
+	test_solve_sphere();
+	test_degenerate_samples();
+	test_origin_shift();
+
+	if (gFailures > 0)
+	{
+		std::printf("%d check(s) failed\n", gFailures);
+		return 1;
+	}
+	std::printf("All checks passed\n");
+	return 0;
+}